@@ -0,0 +1,210 @@
+#include "BrickMap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+BrickMap::BrickMap(int resolution, float fill)
+{
+    m_resolution = resolution;
+    m_bricksPerSide = (resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+
+    size_t count = (size_t)m_bricksPerSide * m_bricksPerSide * m_bricksPerSide;
+    Brick brick;
+    brick.value = fill;
+    m_index.assign(count, brick);
+
+    // Every node can have one partly used chunk
+    int nodes = VolumeMemoryNodeCount();
+    m_pools.resize(nodes);
+    m_chunks.reserve(count / BRICKS_PER_CHUNK + nodes);
+    m_chunkNodes.reserve(m_chunks.capacity());
+}
+
+glm::ivec3 BrickMap::brickCoord(size_t brick) const
+{
+    size_t n = (size_t)m_bricksPerSide;
+    return glm::ivec3(int(brick % n), int((brick / n) % n), int(brick / (n * n)));
+}
+
+const float* BrickMap::brickData(size_t brick) const
+{
+    uint32_t slot = m_index[brick].slot;
+    return slot == CONSTANT_BRICK ? nullptr : slotData(slot);
+}
+
+uint32_t BrickMap::allocateSlot()
+{
+    int nodes = (int)m_pools.size();
+    int home = CurrentVolumeMemoryNode() % nodes;
+    std::lock_guard<std::mutex> lock(*m_poolMutex);
+
+    // The calling thread's node first, its freed slots and then its chunk's tail. Other nodes only
+    // lend freed slots, never their tails, so a new chunk is added once every free list is empty and
+    // every other node has at most one partly used chunk: never more than count / BRICKS_PER_CHUNK + nodes
+    // chunks, and m_chunks stays within its reservation.
+    NodePool& own = m_pools[home];
+    if (!own.freeSlots.empty())
+    {
+        uint32_t slot = own.freeSlots.back();
+        own.freeSlots.pop_back();
+        return slot;
+    }
+    if (own.next != own.end)
+    {
+        return own.next++;
+    }
+    for (int i = 1; i < nodes; ++i)
+    {
+        NodePool& other = m_pools[(home + i) % nodes];
+        if (!other.freeSlots.empty())
+        {
+            uint32_t slot = other.freeSlots.back();
+            other.freeSlots.pop_back();
+            return slot;
+        }
+    }
+
+    own.next = uint32_t(m_chunks.size() * BRICKS_PER_CHUNK);
+    own.end = own.next + uint32_t(BRICKS_PER_CHUNK);
+    m_chunks.emplace_back(static_cast<float*>(AllocateVolumeMemory(VOLUME_PAGE_BYTES, home)));
+    m_chunkNodes.push_back(home);
+    return own.next++;
+}
+
+void BrickMap::setBrick(size_t brick, const float* voxels)
+{
+    bool constant = std::all_of(voxels + 1, voxels + BRICK_VOXELS, [&](float v) { return v == voxels[0]; });
+    if (constant)
+    {
+        setConstant(brick, voxels[0]);
+        return;
+    }
+
+    Brick& entry = m_index[brick];
+    if (entry.slot == CONSTANT_BRICK)
+    {
+        entry.slot = allocateSlot();
+    }
+    memcpy(slotData(entry.slot), voxels, BRICK_VOXELS * sizeof(float));
+}
+
+void BrickMap::setConstant(size_t brick, float value)
+{
+    // The slot of a brick that was dense goes back to the pool for the next dense brick
+    if (m_index[brick].slot != CONSTANT_BRICK)
+    {
+        uint32_t slot = m_index[brick].slot;
+        std::lock_guard<std::mutex> lock(*m_poolMutex);
+        m_pools[m_chunkNodes[slot / BRICKS_PER_CHUNK]].freeSlots.push_back(slot);
+    }
+    m_index[brick].slot = CONSTANT_BRICK;
+    m_index[brick].value = value;
+}
+
+void BrickMap::readBrick(size_t brick, float* voxels) const
+{
+    const float* data = brickData(brick);
+    if (data)
+    {
+        memcpy(voxels, data, BRICK_VOXELS * sizeof(float));
+    }
+    else
+    {
+        std::fill(voxels, voxels + BRICK_VOXELS, m_index[brick].value);
+    }
+}
+
+float BrickMap::voxel(int x, int y, int z) const
+{
+    size_t brick = brickIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+    const float* data = brickData(brick);
+    if (!data)
+    {
+        return m_index[brick].value;
+    }
+    int lx = x % BRICK_SIZE, ly = y % BRICK_SIZE, lz = z % BRICK_SIZE;
+    return data[lx + BRICK_SIZE * (ly + BRICK_SIZE * lz)];
+}
+
+void BrickMap::readSlab(int z0, int depth, float* out) const
+{
+    size_t n = (size_t)m_resolution;
+    for (int z = z0; z < z0 + depth; ++z)
+    {
+        int bz = z / BRICK_SIZE, lz = z % BRICK_SIZE;
+        for (int y = 0; y < m_resolution; ++y)
+        {
+            int by = y / BRICK_SIZE, ly = y % BRICK_SIZE;
+            float* row = out + n * ((size_t)y + n * (size_t)(z - z0));
+            for (int bx = 0; bx < m_bricksPerSide; ++bx)
+            {
+                size_t brick = brickIndex(bx, by, bz);
+                int x0 = bx * BRICK_SIZE;
+                int width = std::min(BRICK_SIZE, m_resolution - x0);
+                const float* data = brickData(brick);
+                if (data)
+                {
+                    memcpy(row + x0, data + BRICK_SIZE * (ly + BRICK_SIZE * lz), width * sizeof(float));
+                }
+                else
+                {
+                    std::fill(row + x0, row + x0 + width, m_index[brick].value);
+                }
+            }
+        }
+    }
+}
+
+glm::vec2 BrickMap::valueRange(glm::ivec3 lo, glm::ivec3 hi) const
+{
+    lo = glm::max(lo, glm::ivec3(0));
+    hi = glm::min(hi, glm::ivec3(m_resolution));
+    glm::vec2 range(FLT_MAX, -FLT_MAX);
+
+    glm::ivec3 first = lo / BRICK_SIZE, last = (hi - 1) / BRICK_SIZE;
+    for (int bz = first.z; bz <= last.z; ++bz)
+    {
+        for (int by = first.y; by <= last.y; ++by)
+        {
+            for (int bx = first.x; bx <= last.x; ++bx)
+            {
+                size_t brick = brickIndex(bx, by, bz);
+                const float* data = brickData(brick);
+                if (!data)
+                {
+                    range = glm::vec2(std::min(range.x, m_index[brick].value), std::max(range.y, m_index[brick].value));
+                    continue;
+                }
+
+                // Only the part of the brick inside [lo, hi)
+                glm::ivec3 origin = glm::ivec3(bx, by, bz) * BRICK_SIZE;
+                glm::ivec3 a = glm::max(lo, origin) - origin;
+                glm::ivec3 b = glm::min(hi, origin + BRICK_SIZE) - origin;
+                for (int z = a.z; z < b.z; ++z)
+                {
+                    for (int y = a.y; y < b.y; ++y)
+                    {
+                        const float* row = data + BRICK_SIZE * (y + BRICK_SIZE * z);
+                        for (int x = a.x; x < b.x; ++x)
+                        {
+                            range.x = std::min(range.x, row[x]);
+                            range.y = std::max(range.y, row[x]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return range;
+}
+
+size_t BrickMap::denseBrickCount() const
+{
+    return (size_t)std::count_if(m_index.begin(), m_index.end(), [](const Brick& b) { return b.slot != CONSTANT_BRICK; });
+}
+
+size_t BrickMap::memoryBytes() const
+{
+    return m_index.size() * sizeof(Brick) + m_chunks.size() * BRICKS_PER_CHUNK * BRICK_VOXELS * sizeof(float);
+}
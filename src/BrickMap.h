@@ -0,0 +1,108 @@
+#pragma once
+
+#include "VolumeMemory.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const int BRICK_SIZE = 8;
+const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+// Sparse resolution^3 volume made of 8^3 voxel bricks.
+// A brick whose voxels all have the same value (empty space, solid interior) is stored as that
+// single value in the index; only the others take BRICK_VOXELS floats in the brick pool.
+// Voxels inside a brick are stored x fastest, then y, then z, like the dense texture layout.
+class BrickMap
+{
+public:
+    BrickMap() = default;
+    explicit BrickMap(int resolution, float fill = 0.f);
+
+    BrickMap(BrickMap&&) = default;
+    BrickMap& operator=(BrickMap&&) = default;
+
+    int resolution() const          { return m_resolution; }
+    int bricksPerSide() const       { return m_bricksPerSide; }
+    size_t brickCount() const       { return m_index.size(); }
+    bool empty() const              { return m_index.empty(); }
+
+    size_t brickIndex(int bx, int by, int bz) const
+    {
+        return (size_t)bx + (size_t)m_bricksPerSide * ((size_t)by + (size_t)m_bricksPerSide * (size_t)bz);
+    }
+    glm::ivec3 brickCoord(size_t brick) const;
+
+    bool isConstant(size_t brick) const             { return m_index[brick].slot == CONSTANT_BRICK; }
+    float constantValue(size_t brick) const         { return m_index[brick].value; }
+
+    // Voxels of a non-constant brick, nullptr for constant ones
+    const float* brickData(size_t brick) const;
+
+    // Stores a full brick, collapsing it to a constant if all voxels are equal.
+    // Different bricks can be set from different threads at the same time. A brick that becomes
+    // constant frees its voxels for reuse by later dense bricks, so a volume streamed out a few
+    // layers at a time only ever holds those layers.
+    void setBrick(size_t brick, const float* voxels);
+    void setConstant(size_t brick, float value);
+
+    // Expands one brick into BRICK_VOXELS floats
+    void readBrick(size_t brick, float* voxels) const;
+
+    float voxel(int x, int y, int z) const;
+
+    // Expands layers [z0, z0 + depth) to dense x-fastest rows, the layout glTexSubImage3D expects
+    void readSlab(int z0, int depth, float* out) const;
+
+    // Min (x) and max (y) voxel value over [lo, hi), clamped to the volume
+    glm::vec2 valueRange(glm::ivec3 lo, glm::ivec3 hi) const;
+
+    size_t denseBrickCount() const;
+    size_t memoryBytes() const;
+
+private:
+    static const uint32_t CONSTANT_BRICK = 0xffffffffu;
+    // One large page per chunk
+    static const size_t BRICKS_PER_CHUNK = VOLUME_PAGE_BYTES / (BRICK_VOXELS * sizeof(float));
+
+    struct Brick
+    {
+        uint32_t slot = CONSTANT_BRICK;
+        float value = 0.f;
+    };
+
+    struct ChunkDeleter
+    {
+        void operator()(float* chunk) const { FreeVolumeMemory(chunk, VOLUME_PAGE_BYTES); }
+    };
+
+    // Slots of the chunks on one NUMA node
+    struct NodePool
+    {
+        uint32_t next = 0;      // next never used slot of the node's newest chunk
+        uint32_t end = 0;
+        std::vector<uint32_t> freeSlots;
+    };
+
+    float* slotData(uint32_t slot) const
+    {
+        return m_chunks[slot / BRICKS_PER_CHUNK].get() + (size_t)(slot % BRICKS_PER_CHUNK) * BRICK_VOXELS;
+    }
+    uint32_t allocateSlot();
+
+    int m_resolution = 0;
+    int m_bricksPerSide = 0;
+    std::vector<Brick> m_index;
+
+    // Pool of dense bricks, allocated in fixed chunks so slots never move while other threads write them.
+    // m_chunks is reserved up front and never reallocates. A brick gets a slot on the NUMA node of
+    // the thread that sets it, or a freed slot of another node before a new chunk is added; each chunk
+    // lives on one node (m_chunkNodes).
+    std::vector<std::unique_ptr<float[], ChunkDeleter>> m_chunks;
+    std::vector<int> m_chunkNodes;
+    std::vector<NodePool> m_pools;
+    std::unique_ptr<std::mutex> m_poolMutex = std::make_unique<std::mutex>();
+};
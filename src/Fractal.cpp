@@ -0,0 +1,451 @@
+#include "Fractal.h"
+#include "Triplex.h"
+
+#include <algorithm>
+#include <cmath>
+
+float MandelbulbInteriorRadius(float order)
+{
+    if (order <= 1.0f)
+    {
+        return 0.0f;
+    }
+    double n = order;
+    double r = pow(n, -1.0 / (n - 1.0));
+    return float(r - pow(r, n));
+}
+
+// Brent-style cycle check on the orbit. z is saved whenever the iteration count reaches a power
+// of two; float arithmetic is deterministic, so an orbit that comes back to exactly the saved z
+// repeats the same cycle forever and never escapes.
+struct OrbitCycle
+{
+    glm::vec3 saved;
+    int next = 1;
+
+    explicit OrbitCycle(glm::vec3 start) : saved(start) {}
+
+    // z is the orbit after iteration i (counting from 1)
+    bool repeats(int i, glm::vec3 z)
+    {
+        if (z == saved)
+        {
+            return true;
+        }
+        if (i == next)
+        {
+            saved = z;
+            next *= 2;
+        }
+        return false;
+    }
+};
+
+template<int Order>
+int MandelbulbIteration(glm::vec3 point, int maxIterations)
+{
+    if (glm::dot(point, point) <= IntegerPower<2>(MandelbulbInteriorRadius(float(Order))))
+    {
+        return maxIterations;
+    }
+
+    float x = point.x;
+    float y = point.y;
+    float z = point.z;
+    OrbitCycle cycle(point);
+    int i = 0;
+    for (i = 0; i < maxIterations; i++) {
+        if (x * x + y * y + z * z > 4.0f)
+        {
+            break; // Escape condition, r > 2
+        }
+        TriplexPower<Order>(x, y, z);
+        x += point.x;
+        y += point.y;
+        z += point.z;
+        if (cycle.repeats(i + 1, glm::vec3(x, y, z)))
+        {
+            return maxIterations;
+        }
+    }
+    return i;
+}
+
+template int MandelbulbIteration<2>(glm::vec3, int);
+template int MandelbulbIteration<3>(glm::vec3, int);
+template int MandelbulbIteration<4>(glm::vec3, int);
+template int MandelbulbIteration<5>(glm::vec3, int);
+template int MandelbulbIteration<6>(glm::vec3, int);
+template int MandelbulbIteration<7>(glm::vec3, int);
+template int MandelbulbIteration<8>(glm::vec3, int);
+template int MandelbulbIteration<9>(glm::vec3, int);
+template int MandelbulbIteration<10>(glm::vec3, int);
+template int MandelbulbIteration<11>(glm::vec3, int);
+template int MandelbulbIteration<12>(glm::vec3, int);
+template int MandelbulbIteration<13>(glm::vec3, int);
+template int MandelbulbIteration<14>(glm::vec3, int);
+template int MandelbulbIteration<15>(glm::vec3, int);
+template int MandelbulbIteration<16>(glm::vec3, int);
+
+int MandelbulbIteration(glm::vec3 point, float order, int maxIterations) {
+    switch (IntegerOrder(order))
+    {
+    case 2: return MandelbulbIteration<2>(point, maxIterations);
+    case 3: return MandelbulbIteration<3>(point, maxIterations);
+    case 4: return MandelbulbIteration<4>(point, maxIterations);
+    case 5: return MandelbulbIteration<5>(point, maxIterations);
+    case 6: return MandelbulbIteration<6>(point, maxIterations);
+    case 7: return MandelbulbIteration<7>(point, maxIterations);
+    case 8: return MandelbulbIteration<8>(point, maxIterations);
+    case 9: return MandelbulbIteration<9>(point, maxIterations);
+    case 10: return MandelbulbIteration<10>(point, maxIterations);
+    case 11: return MandelbulbIteration<11>(point, maxIterations);
+    case 12: return MandelbulbIteration<12>(point, maxIterations);
+    case 13: return MandelbulbIteration<13>(point, maxIterations);
+    case 14: return MandelbulbIteration<14>(point, maxIterations);
+    case 15: return MandelbulbIteration<15>(point, maxIterations);
+    case 16: return MandelbulbIteration<16>(point, maxIterations);
+    default: break;
+    }
+
+    // Fractional order, fall back to the polar form
+    float interior = MandelbulbInteriorRadius(order);
+    if (glm::dot(point, point) <= interior * interior)
+    {
+        return maxIterations;
+    }
+    glm::vec3 z = point;
+    OrbitCycle cycle(point);
+    float dr = 1.0;
+    float r = 0.0;
+    int i = 0;
+    for (i = 0; i < maxIterations; i++) {
+        r = glm::length(z);
+        if (r > 2.0)
+        {
+            break; // Escape condition
+        }
+        // Convert to polar coordinates
+        float theta = acos(z.z / r);
+        float phi = atan2(z.y, z.x);
+        dr = pow(r, order - 1.0) * order * dr + 1.0;
+
+        // Scale and rotate the point
+        float zr = pow(r, order);
+        theta *= order;
+        phi *= order;
+
+        // Convert back to Cartesian coordinates
+        z = glm::vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta)) * zr + point;
+        if (cycle.repeats(i + 1, z))
+        {
+            return maxIterations;
+        }
+    }
+    return i;
+}
+
+// MandelbulbIteration<Order> that also tracks the derivative dr = Order * r^(Order - 1) * dr + 1
+template<int Order>
+static float mandelbulb_distance(glm::vec3 point, int maxIterations)
+{
+    if (glm::dot(point, point) <= IntegerPower<2>(MandelbulbInteriorRadius(float(Order))))
+    {
+        return 0.0f;
+    }
+
+    float x = point.x;
+    float y = point.y;
+    float z = point.z;
+    float dr = 1.0f;
+    OrbitCycle cycle(point);
+    for (int i = 0; i < maxIterations; i++) {
+        float r2 = x * x + y * y + z * z;
+        if (r2 > 4.0f)
+        {
+            float r = sqrtf(r2);
+            return 0.5f * logf(r) * r / dr;
+        }
+        dr = float(Order) * IntegerPower<Order - 1>(sqrtf(r2)) * dr + 1.0f;
+        TriplexPower<Order>(x, y, z);
+        x += point.x;
+        y += point.y;
+        z += point.z;
+        if (cycle.repeats(i + 1, glm::vec3(x, y, z)))
+        {
+            return 0.0f;
+        }
+    }
+    return 0.0f;
+}
+
+float MandelbulbDistance(glm::vec3 point, float order, int maxIterations)
+{
+    switch (IntegerOrder(order))
+    {
+    case 2: return mandelbulb_distance<2>(point, maxIterations);
+    case 3: return mandelbulb_distance<3>(point, maxIterations);
+    case 4: return mandelbulb_distance<4>(point, maxIterations);
+    case 5: return mandelbulb_distance<5>(point, maxIterations);
+    case 6: return mandelbulb_distance<6>(point, maxIterations);
+    case 7: return mandelbulb_distance<7>(point, maxIterations);
+    case 8: return mandelbulb_distance<8>(point, maxIterations);
+    case 9: return mandelbulb_distance<9>(point, maxIterations);
+    case 10: return mandelbulb_distance<10>(point, maxIterations);
+    case 11: return mandelbulb_distance<11>(point, maxIterations);
+    case 12: return mandelbulb_distance<12>(point, maxIterations);
+    case 13: return mandelbulb_distance<13>(point, maxIterations);
+    case 14: return mandelbulb_distance<14>(point, maxIterations);
+    case 15: return mandelbulb_distance<15>(point, maxIterations);
+    case 16: return mandelbulb_distance<16>(point, maxIterations);
+    default: break;
+    }
+
+    float interior = MandelbulbInteriorRadius(order);
+    if (glm::dot(point, point) <= interior * interior)
+    {
+        return 0.0f;
+    }
+    glm::vec3 z = point;
+    OrbitCycle cycle(point);
+    float dr = 1.0;
+    for (int i = 0; i < maxIterations; i++) {
+        float r = glm::length(z);
+        if (r > 2.0)
+        {
+            return 0.5f * log(r) * r / dr;
+        }
+        float theta = acos(z.z / r) * order;
+        float phi = atan2(z.y, z.x) * order;
+        dr = pow(r, order - 1.0) * order * dr + 1.0;
+        z = glm::vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta)) * powf(r, order) + point;
+        if (cycle.repeats(i + 1, z))
+        {
+            return 0.0f;
+        }
+    }
+    return 0.0f;
+}
+
+float MandelbulbDensity(glm::vec3 point, float order, int maxIterations)
+{
+    return float(MandelbulbIteration(point, order, maxIterations)) / float(maxIterations);
+}
+
+float MandelboxDensity(glm::vec3 point, float order, int maxIterations)
+{
+    glm::vec3 zeta = point;
+    float rad = glm::length(zeta);
+    int i = 0;
+    for (i = 0; i < maxIterations; i++) {
+        if (rad > MANDELBOX_BAILOUT)
+        {
+            break; // Escape condition
+        }
+        // Box fold
+        zeta = glm::clamp(zeta, -1.0f, 1.0f) * 2.0f - zeta;
+
+        // Sphere fold
+        if (rad < 0.5f)
+            zeta *= 4.0f;
+        else if (rad < 1.0f)
+            zeta /= rad * rad;
+
+        zeta = zeta * order + point;
+        rad = glm::length(zeta);
+    }
+    return float(i) / float(maxIterations);
+}
+
+float MandelboxDistance(glm::vec3 point, float order, int maxIterations)
+{
+    glm::vec3 zeta = point;
+    float rad = glm::length(zeta);
+    float dr = 1.0f;
+    for (int i = 0; i < maxIterations; i++) {
+        if (rad > MANDELBOX_BAILOUT)
+        {
+            return rad / fabs(dr);
+        }
+        zeta = glm::clamp(zeta, -1.0f, 1.0f) * 2.0f - zeta;
+
+        float fold = 1.0f;
+        if (rad < 0.5f)
+            fold = 4.0f;
+        else if (rad < 1.0f)
+            fold = 1.0f / (rad * rad);
+
+        zeta = zeta * fold * order + point;
+        dr = dr * fold * fabs(order) + 1.0f;
+        rad = glm::length(zeta);
+    }
+    return 0.0f;
+}
+
+// GLSL mod(), which always returns a value with the sign of y
+static float glsl_mod(float x, float y)
+{
+    return x - y * floor(x / y);
+}
+
+static bool in_middle_third(float v)
+{
+    return v > 1.0f / 3.0f && v < 2.0f / 3.0f;
+}
+
+float MengerSpongeDensity(glm::vec3 point, int maxIterations)
+{
+    glm::vec3 pos = point;
+    float scale = 1.0f;
+    for (int i = 0; i < maxIterations; ++i) {
+        // Fold space back onto itself
+        pos = glm::vec3(glsl_mod(pos.x, scale), glsl_mod(pos.y, scale), glsl_mod(pos.z, scale)) - 0.5f * scale;
+        if (scale > 0.01f) {
+            pos = glm::abs(pos) / scale;
+        }
+
+        bool x = in_middle_third(pos.x);
+        bool y = in_middle_third(pos.y);
+        bool z = in_middle_third(pos.z);
+        if ((x && (y || z)) || (y && z)) {
+            return 0.0f; // Inside a hole
+        }
+
+        scale /= 3.0f;
+    }
+    return 1.0f;
+}
+
+float MengerSpongeDistance(glm::vec3 point, int maxIterations)
+{
+    glm::vec3 pos = point;
+    float scale = 1.0f;
+    float stretch = 1.0f;
+    for (int i = 0; i < maxIterations; ++i) {
+        pos = glm::vec3(glsl_mod(pos.x, scale), glsl_mod(pos.y, scale), glsl_mod(pos.z, scale)) - 0.5f * scale;
+        if (scale <= 0.01f) {
+            break; // Without the abs and divide pos never reaches the middle third again
+        }
+        pos = glm::abs(pos) / scale;
+        stretch /= scale;
+
+        // pos is at most 0.5 here, so a hole is two or more coordinates above 1/3.
+        // Leaving it means bringing all but one of them back down.
+        glm::vec3 excess = pos - 1.0f / 3.0f;
+        float high = glm::max(glm::max(excess.x, excess.y), excess.z);
+        float low = glm::min(glm::min(excess.x, excess.y), excess.z);
+        float mid = excess.x + excess.y + excess.z - high - low;
+        if (mid > 0.0f) {
+            float d = low > 0.0f ? sqrtf(mid * mid + low * low) : mid;
+            return d / stretch;
+        }
+
+        scale /= 3.0f;
+    }
+    return 0.0f;
+}
+
+float FractalDistance(const FractalParams& params, glm::vec3 point)
+{
+    switch (params.type)
+    {
+    case FRACTAL_MANDELBOX:
+        return MandelboxDistance(point, params.order, params.max_iterations);
+    case FRACTAL_MENGER_SPONGE:
+        return MengerSpongeDistance(point, params.max_iterations);
+    default:
+        return MandelbulbDistance(point, params.order, params.max_iterations);
+    }
+}
+
+float FractalDensity(const FractalParams& params, glm::vec3 point)
+{
+    switch (params.type)
+    {
+    case FRACTAL_MANDELBOX:
+        return MandelboxDensity(point, params.order, params.max_iterations);
+    case FRACTAL_MENGER_SPONGE:
+        return MengerSpongeDensity(point, params.max_iterations);
+    default:
+        return MandelbulbDensity(point, params.order, params.max_iterations);
+    }
+}
+
+float FractalBoundingRadius(const FractalParams& params)
+{
+    return params.type == FRACTAL_MANDELBULB ? 2.0f : 0.0f;
+}
+
+AxisSymmetry AxisSymmetry::after(const AxisSymmetry& other) const
+{
+    AxisSymmetry combined;
+    for (int i = 0; i < 3; ++i)
+    {
+        combined.axis[i] = other.axis[axis[i]];
+        combined.sign[i] = sign[i] * other.sign[axis[i]];
+    }
+    return combined;
+}
+
+static AxisSymmetry mirror(int axis)
+{
+    AxisSymmetry symmetry;
+    symmetry.sign[axis] = -1;
+    return symmetry;
+}
+
+static AxisSymmetry swap(int a, int b)
+{
+    AxisSymmetry symmetry;
+    symmetry.axis[a] = b;
+    symmetry.axis[b] = a;
+    return symmetry;
+}
+
+std::vector<AxisSymmetry> FractalSymmetries(const FractalParams& params)
+{
+    std::vector<AxisSymmetry> generators;
+    if (params.type == FRACTAL_MANDELBULB)
+    {
+        // z^n conjugates with y, and for odd n negating x or z commutes with it too.
+        // A quarter turn about z is one of the n - 1 rotations when 4 divides n - 1.
+        generators.push_back(mirror(1));
+        int n = (int)params.order;
+        if (float(n) == params.order && n >= 2)
+        {
+            if (n % 2 == 1)
+            {
+                generators.push_back(mirror(0));
+                generators.push_back(mirror(2));
+            }
+            if (n % 4 == 1)
+            {
+                generators.push_back(swap(0, 1));
+            }
+        }
+    }
+    else
+    {
+        // Both folds treat every axis alike and are odd in each coordinate
+        generators = { mirror(0), mirror(1), mirror(2), swap(0, 1), swap(1, 2) };
+    }
+
+    // Close the generators under composition
+    std::vector<AxisSymmetry> group(1);
+    for (size_t i = 0; i < group.size(); ++i)
+    {
+        for (const AxisSymmetry& generator : generators)
+        {
+            AxisSymmetry next = generator.after(group[i]);
+            bool known = std::any_of(group.begin(), group.end(), [&](const AxisSymmetry& g)
+            {
+                return g.axis == next.axis && g.sign == next.sign;
+            });
+            if (!known)
+            {
+                group.push_back(next);
+            }
+        }
+    }
+    return group;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// CPU versions of the fractal kernels in shaders/fractals_fs.glsl.
+// Every density is normalized to [0, 1]: 0 is empty space, 1 is solid.
+
+// Same numbering as grid::fractal_type and the fractal_type uniform
+enum FractalType
+{
+    FRACTAL_MANDELBULB = 0,
+    FRACTAL_MANDELBOX = 1,
+    FRACTAL_MENGER_SPONGE = 2
+};
+
+struct FractalParams
+{
+    int type = FRACTAL_MANDELBULB;
+    float order = 8.f;          // Mandelbulb power, Mandelbox scale, unused by the Menger sponge
+    int max_iterations = 10;
+};
+
+// Radius at which a Mandelbox orbit counts as escaped. The shader version never escapes
+// and leaves exterior points to overflow instead.
+const float MANDELBOX_BAILOUT = 1024.f;
+
+// Radius of the ball around the origin that is entirely inside the Mandelbulb of this order:
+// with |z| <= R and |c| <= R - R^order, |z^order + c| <= R again, and R - R^order is largest at
+// R = order^(-1 / (order - 1)). 0 for orders of 1 and below.
+float MandelbulbInteriorRadius(float order);
+
+// Returns the iteration at which the point escaped, or maxIterations if it never did.
+// Points inside MandelbulbInteriorRadius() and orbits that return exactly to an earlier point
+// can never escape and return maxIterations straight away.
+// Integer orders from 2 to 16 run the trig-free MandelbulbIteration<Order>.
+int MandelbulbIteration(glm::vec3 point, float order, int maxIterations);
+
+// Same as above for a fixed integer order, using the closed-form triplex power from Triplex.h
+// instead of acos/atan2/pow/sin/cos. Instantiated in Fractal.cpp for orders 2 to 16.
+template<int Order>
+int MandelbulbIteration(glm::vec3 point, int maxIterations);
+
+// Normalized escape-time density in [0, 1], matching MandelbulbDensity() in the fragment shader
+float MandelbulbDensity(glm::vec3 point, float order, int maxIterations);
+
+// Escape-time density of the Mandelbox in the fragment shader (box fold, sphere fold, scale by order)
+float MandelboxDensity(glm::vec3 point, float order, int maxIterations);
+
+// 1 if the point is solid after maxIterations levels of the shader's Menger sponge, 0 if it falls in a hole
+float MengerSpongeDensity(glm::vec3 point, int maxIterations);
+
+// Density of the selected fractal
+float FractalDensity(const FractalParams& params, glm::vec3 point);
+
+// Radius around the origin outside which the selected fractal has no density and no surface, or 0
+// if there is none to speak of: Mandelbulb orbits past 2 escape before the first iteration, but the
+// Mandelbox's escape-time haze reaches out to MANDELBOX_BAILOUT and the Menger sponge repeats forever.
+float FractalBoundingRadius(const FractalParams& params);
+
+// Distance estimates in fractal space: a lower bound on the distance to the fractal, 0 inside it.
+// Points that never escape within maxIterations count as inside, like a density of 1 above.
+
+// 0.5 * log(r) * r / dr from the running derivative dr of the escaped orbit
+float MandelbulbDistance(glm::vec3 point, float order, int maxIterations);
+
+// r / |dr| of the escaped orbit, with dr scaled by every fold and by the order
+float MandelboxDistance(glm::vec3 point, float order, int maxIterations);
+
+// The sponge has no orbit to differentiate. Every level folds space with a triangle wave and
+// stretches it by 1 / scale, so the distance out of a hole in folded space over the total
+// stretch is a lower bound on the distance to solid space.
+float MengerSpongeDistance(glm::vec3 point, int maxIterations);
+
+// Distance estimate of the selected fractal
+float FractalDistance(const FractalParams& params, glm::vec3 point);
+
+// Signed permutation of the axes, p'[i] = sign[i] * p[axis[i]]. The mirror planes, axis swaps
+// and quarter turns of the fractals below are all of this form.
+struct AxisSymmetry
+{
+    glm::ivec3 axis = glm::ivec3(0, 1, 2);
+    glm::ivec3 sign = glm::ivec3(1);
+
+    glm::vec3 apply(glm::vec3 p) const { return glm::vec3(sign) * glm::vec3(p[axis.x], p[axis.y], p[axis.z]); }
+
+    // This symmetry applied after other
+    AxisSymmetry after(const AxisSymmetry& other) const;
+};
+
+// Every signed axis permutation that maps the selected fractal onto itself, the identity first.
+// The Mandelbox and the Menger sponge have all 48. The Mandelbulb of order n has (n - 1)-fold
+// rotational symmetry about z and mirrors in y; of those rotations only the half and quarter
+// turns permute axes, so it gets the y mirror, the x and z mirrors for odd n, and the swap of
+// x and y for n = 1 mod 4.
+std::vector<AxisSymmetry> FractalSymmetries(const FractalParams& params);
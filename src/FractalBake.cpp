@@ -0,0 +1,509 @@
+// Headless batch baker: bakes volumes into the viewer's cache directory without a window or
+// GL context, sweeping over fractal parameters. Meant for pre-baking on machines with no display.
+//
+//   FractalBake --type mandelbulb --order 2:16:1 --iterations 10 --resolution 256,512
+//
+// Every combination of the listed types, orders, iteration counts, resolutions and fields is
+// baked on every core and written to <cache>/<key>.fbz, the file the viewer's VolumeCache
+// looks up. Volumes already in the cache are skipped unless --force is given.
+//
+// With --sequence the order sweep is written to a single volume sequence (VolumeSequence.h) for
+// the viewer to play back instead.
+
+#include "FractalSimd.h"
+#include "MappedFile.h"
+#include "PagedVolume.h"
+#include "VolumeCache.h"
+#include "VolumeCodec.h"
+#include "VolumeMemory.h"
+#include "VolumeSequence.h"
+#include "VoxelBaker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace options
+{
+    std::vector<int> types = { FRACTAL_MANDELBULB };
+    std::vector<float> orders = { 8.f };
+    std::vector<int> iterations = { 10 };
+    std::vector<int> resolutions = { 512 };
+    std::vector<int> fields = { BAKE_DENSITY };
+    glm::vec3 bounds_min = glm::vec3(-1.5f);
+    glm::vec3 bounds_max = glm::vec3(1.5f);
+
+    std::string cache_dir = "../cache";
+    int threads = 0;
+    bool simd = true;
+    int simd_level = -1;            // >= 0 caps the kernels at this SimdLevel
+    bool symmetry = true;
+    bool intervals = true;
+    int strategy = BAKE_EVERY_VOXEL;
+    bool verify = false;            // compare every bake against one that evaluates every voxel
+    bool force = false;
+    int out_of_core_layers = 0;     // > 0 bakes straight to the file this many brick layers at a time
+    std::string sequence_path;      // non-empty writes the orders as one sequence to this file
+    int keyframe_interval = 16;
+}
+
+static void print_usage()
+{
+    std::cout <<
+        "Usage: FractalBake [options]\n"
+        "  --type T          mandelbulb, mandelbox, menger or 0-2; comma separated for several\n"
+        "  --order R         Mandelbulb power / Mandelbox scale, a list or a start:end:step range\n"
+        "  --iterations R    maximum iterations, a list or a start:end:step range\n"
+        "  --resolution R    volume resolution, a list or a start:end:step range\n"
+        "  --field F         density, distance or both\n"
+        "  --bounds A,B      cube from A to B on every axis, or minx,miny,minz,maxx,maxy,maxz\n"
+        "  --cache DIR       cache directory the viewer loads from (default ../cache)\n"
+        "  --threads N       worker threads, 0 for one per hardware thread (default)\n"
+        "  --scalar          use the scalar kernels instead of SIMD\n"
+        "  --simd L          cap the SIMD kernels at scalar, avx2 or avx512 to test the fallbacks\n"
+        "  --no-symmetry     evaluate every brick instead of mirroring the fractal's symmetric ones\n"
+        "  --no-intervals    evaluate every brick instead of proving some constant by interval arithmetic\n"
+        "  --subdivide       bake densities by recursive subdivision, filling boxes with uniform faces\n"
+        "  --carve           bake by sphere carving, leaving boxes inside distance estimates empty\n"
+        "  --verify          rebake every volume evaluating every voxel and report where they differ;\n"
+        "                    with --out-of-core the written file is read back a pass at a time\n"
+        "  --out-of-core N   bake and write N brick layers at a time instead of the whole volume\n"
+        "  --force           rebake volumes that are already cached\n"
+        "  --sequence FILE   write every order as one frame of a volume sequence instead\n"
+        "  --keyframes N     frames between two keyframes of a sequence (default 16)\n";
+}
+
+static std::vector<std::string> split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+// "a,b,c" or an inclusive "start:end:step" range
+template<class T>
+static bool parse_range(const std::string& text, std::vector<T>& values)
+{
+    values.clear();
+    std::vector<std::string> range = split(text, ':');
+    if (range.size() == 2 || range.size() == 3)
+    {
+        double start = atof(range[0].c_str()), end = atof(range[1].c_str());
+        double step = range.size() == 3 ? atof(range[2].c_str()) : 1.0;
+        if (step <= 0.0)
+        {
+            return false;
+        }
+        // Half a step of slack so float ranges include their end
+        for (double v = start; v <= end + step * 0.5; v += step)
+        {
+            values.push_back(T(v));
+        }
+        return !values.empty();
+    }
+    for (const std::string& part : split(text, ','))
+    {
+        values.push_back(T(atof(part.c_str())));
+    }
+    return !values.empty();
+}
+
+static bool parse_type(const std::string& name, int& type)
+{
+    if (name == "mandelbulb" || name == "0")        type = FRACTAL_MANDELBULB;
+    else if (name == "mandelbox" || name == "1")    type = FRACTAL_MANDELBOX;
+    else if (name == "menger" || name == "2")       type = FRACTAL_MENGER_SPONGE;
+    else                                            return false;
+    return true;
+}
+
+static const char* type_name(int type)
+{
+    switch (type)
+    {
+    case FRACTAL_MANDELBOX:     return "mandelbox";
+    case FRACTAL_MENGER_SPONGE: return "menger";
+    default:                    return "mandelbulb";
+    }
+}
+
+static bool takes_value(const std::string& arg)
+{
+    for (const char* option : { "--type", "--order", "--iterations", "--resolution", "--field", "--bounds", "--cache", "--threads", "--simd", "--out-of-core", "--sequence", "--keyframes" })
+    {
+        if (arg == option)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_arguments(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        std::string value = has_value ? argv[i + 1] : "";
+        bool ok = true;
+
+        if (arg == "--help" || arg == "-h")
+        {
+            return false;
+        }
+        else if (arg == "--scalar")
+        {
+            options::simd = false;
+            continue;
+        }
+        else if (arg == "--no-symmetry")
+        {
+            options::symmetry = false;
+            continue;
+        }
+        else if (arg == "--no-intervals")
+        {
+            options::intervals = false;
+            continue;
+        }
+        else if (arg == "--subdivide")
+        {
+            options::strategy = BAKE_SUBDIVIDE;
+            continue;
+        }
+        else if (arg == "--carve")
+        {
+            options::strategy = BAKE_CARVE;
+            continue;
+        }
+        else if (arg == "--verify")
+        {
+            options::verify = true;
+            continue;
+        }
+        else if (arg == "--force")
+        {
+            options::force = true;
+            continue;
+        }
+        else if (!takes_value(arg))
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        else if (!has_value)
+        {
+            std::cerr << arg << " needs a value" << std::endl;
+            return false;
+        }
+        else if (arg == "--type")
+        {
+            options::types.clear();
+            for (const std::string& name : split(value, ','))
+            {
+                int type;
+                ok = ok && parse_type(name, type);
+                options::types.push_back(type);
+            }
+        }
+        else if (arg == "--order")
+        {
+            ok = parse_range(value, options::orders);
+        }
+        else if (arg == "--iterations")
+        {
+            ok = parse_range(value, options::iterations);
+        }
+        else if (arg == "--resolution")
+        {
+            ok = parse_range(value, options::resolutions);
+        }
+        else if (arg == "--field")
+        {
+            if (value == "density")         options::fields = { BAKE_DENSITY };
+            else if (value == "distance")   options::fields = { BAKE_DISTANCE };
+            else if (value == "both")       options::fields = { BAKE_DENSITY, BAKE_DISTANCE };
+            else                            ok = false;
+        }
+        else if (arg == "--bounds")
+        {
+            std::vector<float> b;
+            ok = parse_range(value, b) && (b.size() == 2 || b.size() == 6);
+            if (ok && b.size() == 2)
+            {
+                options::bounds_min = glm::vec3(b[0]);
+                options::bounds_max = glm::vec3(b[1]);
+            }
+            else if (ok)
+            {
+                options::bounds_min = glm::vec3(b[0], b[1], b[2]);
+                options::bounds_max = glm::vec3(b[3], b[4], b[5]);
+            }
+        }
+        else if (arg == "--cache")
+        {
+            options::cache_dir = value;
+        }
+        else if (arg == "--threads")
+        {
+            options::threads = atoi(value.c_str());
+        }
+        else if (arg == "--simd")
+        {
+            if (value == "scalar")          options::simd_level = SIMD_SCALAR;
+            else if (value == "avx2")       options::simd_level = SIMD_AVX2;
+            else if (value == "avx512")     options::simd_level = SIMD_AVX512;
+            else                            ok = false;
+        }
+        else if (arg == "--out-of-core")
+        {
+            options::out_of_core_layers = atoi(value.c_str());
+            ok = options::out_of_core_layers > 0;
+        }
+        else if (arg == "--sequence")
+        {
+            options::sequence_path = value;
+        }
+        else if (arg == "--keyframes")
+        {
+            options::keyframe_interval = atoi(value.c_str());
+            ok = options::keyframe_interval > 0;
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Bad value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+// True if path already holds a volume of settings
+static bool is_cached(const std::string& path, const BakeSettings& settings)
+{
+    MappedFile file;
+    VolumeHeader header;
+    return file.open(path) && ReadVolumeHeader(file.data(), file.size(), header) && HeaderMatches(header, settings);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bakes every order into one sequence. Only one order varies, so every other option takes its first value.
+static int bake_sequence()
+{
+    BakeSettings settings;
+    settings.fractal.type = options::types.front();
+    settings.fractal.max_iterations = options::iterations.front();
+    settings.resolution = options::resolutions.front();
+    settings.field = options::fields.front();
+    settings.bounds_min = options::bounds_min;
+    settings.bounds_max = options::bounds_max;
+    settings.threads = options::threads;
+    settings.simd = options::simd;
+    settings.symmetry = options::symmetry;
+    settings.intervals = options::intervals;
+    settings.strategy = options::strategy;
+
+    VolumeSequenceWriter writer;
+    if (!writer.open(options::sequence_path, settings, options::keyframe_interval, VolumeCacheMaxError(settings), settings.threads))
+    {
+        return 1;
+    }
+    std::cout << "Baking " << options::orders.size() << " frames of " << type_name(settings.fractal.type) << " at "
+              << settings.resolution << "^3 into " << options::sequence_path << std::endl;
+
+    auto total_start = std::chrono::steady_clock::now();
+    double bake_seconds = 0.0, save_seconds = 0.0;
+    for (size_t i = 0; i < options::orders.size(); ++i)
+    {
+        settings.fractal.order = options::orders[i];
+        BrickMap volume;
+        BakeStats stats;
+        BakeVolume(settings, volume, &stats);
+        auto save_start = std::chrono::steady_clock::now();
+        if (!writer.append(volume, settings.fractal.order))
+        {
+            std::cerr << "Failed to write " << options::sequence_path << std::endl;
+            return 1;
+        }
+        double save = seconds_since(save_start);
+        bake_seconds += stats.seconds;
+        save_seconds += save;
+
+        const SequenceFrame& frame = writer.frames().back();
+        printf("[%zu/%zu] order %g: bake %.2f s, encode + write %.2f s, %u of %zu bricks, %.1f MB\n", i + 1, options::orders.size(),
+               settings.fractal.order, stats.seconds, save, frame.bricks, volume.brickCount(), double(frame.bytes) / (1024.0 * 1024.0));
+    }
+    if (!writer.finish())
+    {
+        return 1;
+    }
+
+    std::error_code error;
+    printf("%zu frames in %.2f s: bake %.2f s, encode + write %.2f s, %.1f MB\n", options::orders.size(), seconds_since(total_start),
+           bake_seconds, save_seconds, double(std::filesystem::file_size(options::sequence_path, error)) / (1024.0 * 1024.0));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (!parse_arguments(argc, argv))
+    {
+        print_usage();
+        return 1;
+    }
+    if (options::simd_level >= 0)
+    {
+        // Levels the CPU doesn't support fall back to the best one it does
+        SetSimdLevel((SimdLevel)options::simd_level);
+    }
+    if (options::verify && !options::sequence_path.empty())
+    {
+        std::cerr << "--verify can't be combined with --sequence" << std::endl;
+        return 1;
+    }
+    if (!options::sequence_path.empty())
+    {
+        return bake_sequence();
+    }
+
+    std::vector<BakeSettings> jobs;
+    for (int type : options::types)
+    {
+        // The Menger sponge has no order, don't bake the same sponge once per order
+        std::vector<float> orders = type == FRACTAL_MENGER_SPONGE ? std::vector<float>{ options::orders.front() } : options::orders;
+        for (float order : orders)
+        {
+            for (int iterations : options::iterations)
+            {
+                for (int resolution : options::resolutions)
+                {
+                    for (int field : options::fields)
+                    {
+                        BakeSettings settings;
+                        settings.fractal.type = type;
+                        settings.fractal.order = order;
+                        settings.fractal.max_iterations = iterations;
+                        settings.resolution = resolution;
+                        settings.field = field;
+                        settings.bounds_min = options::bounds_min;
+                        settings.bounds_max = options::bounds_max;
+                        settings.threads = options::threads;
+                        settings.simd = options::simd;
+                        settings.symmetry = options::symmetry;
+                        settings.intervals = options::intervals;
+                        settings.strategy = options::strategy;
+                        jobs.push_back(settings);
+                    }
+                }
+            }
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options::cache_dir, error);
+    std::cout << "Baking " << jobs.size() << " volumes into " << options::cache_dir << " ("
+              << (options::simd ? SimdLevelName(ActiveSimdLevel()) : "scalar") << ")" << std::endl;
+
+    auto total_start = std::chrono::steady_clock::now();
+    double total_voxels = 0.0, bake_seconds = 0.0, save_seconds = 0.0;
+    int baked = 0, skipped = 0, failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const BakeSettings& settings = jobs[i];
+        std::string path = VolumeCachePath(options::cache_dir, settings);
+        printf("[%zu/%zu] %s order %g, %d iterations, %d^3 %s: ", i + 1, jobs.size(), type_name(settings.fractal.type),
+               settings.fractal.order, settings.fractal.max_iterations, settings.resolution,
+               settings.field == BAKE_DISTANCE ? "distance" : "density");
+        fflush(stdout);
+
+        if (!options::force && is_cached(path, settings))
+        {
+            printf("cached\n");
+            ++skipped;
+            continue;
+        }
+
+        BakeStats stats;
+        BakeVerification verification;
+        PagedVolume::Stats pages;
+        double save = 0.0;
+        bool ok;
+        if (options::out_of_core_layers > 0)
+        {
+            // Baking and writing interleave, the stats cover both
+            ok = BakeVolumeToFile(settings, path, options::out_of_core_layers, VolumeCacheMaxError(settings), &stats);
+            if (ok && options::verify)
+            {
+                // Read back with room for one pass worth of bricks, like the bake itself
+                size_t bricks = (size_t)(settings.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+                size_t layer_bytes = sizeof(float) * BRICK_VOXELS * bricks * bricks;
+                verification = VerifyVolumeFile(settings, path, options::out_of_core_layers, VolumeCacheMaxError(settings),
+                                                layer_bytes * options::out_of_core_layers, &pages);
+            }
+        }
+        else
+        {
+            BrickMap volume;
+            BakeVolume(settings, volume, &stats);
+            auto save_start = std::chrono::steady_clock::now();
+            ok = SaveCompressedVolume(volume, settings, path, VolumeCacheMaxError(settings), settings.threads);
+            save = seconds_since(save_start);
+            if (options::verify)
+            {
+                verification = VerifyBake(settings, volume);
+            }
+        }
+
+        if (!ok)
+        {
+            printf("failed to write %s\n", path.c_str());
+            ++failed;
+            continue;
+        }
+        double n = settings.resolution;
+        total_voxels += n * n * n;
+        bake_seconds += stats.seconds;
+        save_seconds += save;
+        ++baked;
+        printf("bake %.2f s (%.1f Mvoxels/s), encode + write %.2f s, %.1f MB\n", stats.seconds, stats.voxels_per_second / 1e6,
+               save, double(std::filesystem::file_size(path, error)) / (1024.0 * 1024.0));
+        if (options::verify)
+        {
+            printf("    verify: %.2f s evaluating every voxel, %zu of %zu voxels differ (%.4f%%) in %zu bricks, worst %g, %zu voxels filled\n",
+                   verification.reference_seconds, verification.mismatched_voxels, verification.voxels,
+                   100.0 * double(verification.mismatched_voxels) / double(std::max<size_t>(verification.voxels, 1)),
+                   verification.mismatched_bricks, verification.max_error, stats.filled_voxels);
+            if (options::out_of_core_layers > 0)
+            {
+                printf("    read back: %zu hits, %zu misses, %zu prefetched, %zu evicted, %zu damaged bricks\n",
+                       pages.hits, pages.misses, pages.prefetched, pages.evicted, pages.damaged);
+            }
+        }
+    }
+
+    double total = seconds_since(total_start);
+    printf("%d baked, %d already cached, %d failed in %.2f s: bake %.2f s, encode + write %.2f s, %.1f Mvoxels/s overall\n",
+           baked, skipped, failed, total, bake_seconds, save_seconds, total_voxels / std::max(total, 1e-9) / 1e6);
+    printf("Bricks on %s pages, %d NUMA node%s\n", VolumeMemoryUsesLargePages() ? "2 MB" : "4 KB", VolumeMemoryNodeCount(),
+           VolumeMemoryNodeCount() > 1 ? "s" : "");
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+#include "FractalInterval.h"
+
+#include "Triplex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // Relative widening of every interval operation, four float roundings. An operation on the
+    // floats inside its operands rounds to within half of one.
+    const double ROUNDING = 1.0 / double(1 << 22);
+
+    // Relative widening of the orbit radius per iteration, for kernels that do the same iteration
+    // in a different order or with approximate pow/sin/cos
+    const double ORBIT_SLACK = 1e-5;
+    const double POLAR_SLACK = 1e-4;
+
+    const double INF = std::numeric_limits<double>::infinity();
+
+    // Closed range of reals, kept in double so the intervals' own rounding stays far below a float's
+    struct Interval
+    {
+        double lo, hi;
+
+        Interval(float value = 0.0f) : lo(value), hi(value) {}
+        Interval(double low, double high) : lo(low), hi(high) {}
+    };
+
+    // Result of comparing two intervals: whether it holds for all, and for any of their values
+    struct IntervalMask
+    {
+        bool all, any;
+    };
+
+    inline Interval rounded(double lo, double hi, double relative = ROUNDING)
+    {
+        if (std::isnan(lo) || std::isnan(hi))
+        {
+            return Interval(-INF, INF);
+        }
+        double margin = std::max(std::abs(lo), std::abs(hi)) * relative + 1e-44;
+        return Interval(lo - margin, hi + margin);
+    }
+
+    inline Interval hull(Interval a, Interval b)
+    {
+        return Interval(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+    }
+
+    // a limited to [lo, hi], a range known to hold its values from elsewhere
+    inline Interval intersect(Interval a, double lo, double hi)
+    {
+        Interval limited(std::max(a.lo, lo), std::min(a.hi, hi));
+        return limited.lo <= limited.hi ? limited : Interval(lo, hi);
+    }
+
+    inline Interval operator+(Interval a, Interval b) { return rounded(a.lo + b.lo, a.hi + b.hi); }
+    inline Interval operator-(Interval a, Interval b) { return rounded(a.lo - b.hi, a.hi - b.lo); }
+
+    inline Interval operator*(Interval a, Interval b)
+    {
+        double p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+        for (double v : p)
+        {
+            if (std::isnan(v))  // 0 * inf
+            {
+                return Interval(-INF, INF);
+            }
+        }
+        return rounded(std::min(std::min(p[0], p[1]), std::min(p[2], p[3])), std::max(std::max(p[0], p[1]), std::max(p[2], p[3])));
+    }
+
+    inline Interval operator/(Interval a, Interval b)
+    {
+        if (b.lo <= 0.0 && b.hi >= 0.0)
+        {
+            return Interval(-INF, INF);
+        }
+        return a * rounded(1.0 / b.hi, 1.0 / b.lo);
+    }
+
+    inline IntervalMask operator>(Interval a, Interval b) { return { a.lo > b.hi, a.hi > b.lo }; }
+
+    // Arguments are sums of squares, which the interval can underestimate below 0
+    inline Interval vsqrt(Interval a) { return rounded(std::sqrt(std::max(a.lo, 0.0)), std::sqrt(std::max(a.hi, 0.0))); }
+
+    inline Interval select(IntervalMask m, Interval a, Interval b)
+    {
+        return m.all ? a : !m.any ? b : hull(a, b);
+    }
+
+    // clamp(v, -1, 1) * 2 - v, the Mandelbox box fold of one coordinate. It falls on v < -1, rises
+    // on [-1, 1] and falls again on v > 1, so the extremes are at the ends and at -1 and 1.
+    inline double box_fold(double v)
+    {
+        return std::min(std::max(v, -1.0), 1.0) * 2.0 - v;
+    }
+
+    inline Interval box_fold(Interval a)
+    {
+        double lo = std::min(box_fold(a.lo), box_fold(a.hi));
+        double hi = std::max(box_fold(a.lo), box_fold(a.hi));
+        if (a.lo < -1.0 && a.hi > -1.0)
+        {
+            lo = std::min(lo, -1.0);
+        }
+        if (a.lo < 1.0 && a.hi > 1.0)
+        {
+            hi = std::max(hi, 1.0);
+        }
+        return rounded(lo, hi);
+    }
+}
+
+// Smallest and largest |c| over the box [lo, hi]
+static void radius_range(glm::vec3 lo, glm::vec3 hi, double& near, double& far)
+{
+    double near2 = 0.0, far2 = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        double a = lo[i], b = hi[i];
+        double closest = a > 0.0 ? a : b < 0.0 ? -b : 0.0;
+        double farthest = std::max(std::abs(a), std::abs(b));
+        near2 += closest * closest;
+        far2 += farthest * farthest;
+    }
+    near = std::sqrt(near2) * (1.0 - ROUNDING);
+    far = std::sqrt(far2) * (1.0 + ROUNDING);
+}
+
+// Escaped at iteration i, with a lower bound on 0.5 * log(r) * r / dr for r >= r_lo > 2
+static RegionBound mandelbulb_escape(int i, double r_lo, double dr_hi)
+{
+    RegionBound bound;
+    bound.kind = REGION_ESCAPES;
+    bound.escape_iteration = i;
+    bound.min_distance = float(0.5 * std::log(r_lo) * r_lo / dr_hi * (1.0 - ROUNDING));
+    return bound;
+}
+
+// Every coordinate as an interval through the same TriplexPower the kernels use. Its result is
+// also limited by |z^n + c| <= |z|^n + |c| and |z^n + c| >= ||z|^n - |c||, which keeps the
+// interval from blowing up where the coordinates alone lose track (around the z axis, for one).
+template<int Order>
+static RegionBound bound_mandelbulb(glm::vec3 lo, glm::vec3 hi, int maxIterations, bool distance)
+{
+    Interval cx(double(lo.x), double(hi.x));
+    Interval cy(double(lo.y), double(hi.y));
+    Interval cz(double(lo.z), double(hi.z));
+    double c_near, c_far;
+    radius_range(lo, hi, c_near, c_far);
+
+    Interval x = cx, y = cy, z = cz;
+    double r_lo = c_near, r_hi = c_far;     // bounds on |z|
+    Interval dr(1.0f);
+    for (int i = 0; i < maxIterations; ++i)
+    {
+        Interval r2 = intersect(x * x + y * y + z * z, r_lo * r_lo * (1.0 - ORBIT_SLACK), r_hi * r_hi * (1.0 + ORBIT_SLACK));
+        if (r2.lo > 4.0)
+        {
+            return mandelbulb_escape(i, std::sqrt(r2.lo), dr.hi);
+        }
+        if (!(r2.hi <= 4.0))
+        {
+            return RegionBound();
+        }
+
+        Interval r = vsqrt(r2);
+        if (distance)
+        {
+            dr = Interval(float(Order)) * IntegerPower<Order - 1>(r) * dr + Interval(1.0f);
+        }
+        Interval power = IntegerPower<Order>(r);
+
+        TriplexPower<Order>(x, y, z);
+        r_hi = power.hi * (1.0 + ORBIT_SLACK) + c_far;
+        r_lo = std::max(std::max(0.0, power.lo * (1.0 - ORBIT_SLACK) - c_far), c_near - power.hi * (1.0 + ORBIT_SLACK));
+        x = intersect(x + cx, -r_hi, r_hi);
+        y = intersect(y + cy, -r_hi, r_hi);
+        z = intersect(z + cz, -r_hi, r_hi);
+    }
+
+    RegionBound bound;
+    bound.kind = REGION_INSIDE;
+    return bound;
+}
+
+// Fractional orders go through acos/atan2/pow, only the radius bounds above are tracked
+static RegionBound bound_polar_mandelbulb(glm::vec3 lo, glm::vec3 hi, float order, int maxIterations, bool distance)
+{
+    if (!(order > 1.0f))
+    {
+        return RegionBound();
+    }
+
+    double c_near, c_far;
+    radius_range(lo, hi, c_near, c_far);
+
+    double n = order;
+    double r_lo = c_near, r_hi = c_far;
+    double dr_hi = 1.0;
+    for (int i = 0; i < maxIterations; ++i)
+    {
+        double low = r_lo * (1.0 - POLAR_SLACK);
+        double high = r_hi * (1.0 + POLAR_SLACK);
+        if (low > 2.0)
+        {
+            return mandelbulb_escape(i, low, dr_hi);
+        }
+        if (!(high <= 2.0))
+        {
+            return RegionBound();
+        }
+
+        if (distance)
+        {
+            dr_hi = std::pow(high, n - 1.0) * n * dr_hi + 1.0;
+        }
+        double power_lo = std::pow(low, n);
+        double power_hi = std::pow(high, n);
+        r_hi = power_hi + c_far;
+        r_lo = std::max(std::max(0.0, power_lo - c_far), c_near - power_hi);
+    }
+
+    RegionBound bound;
+    bound.kind = REGION_INSIDE;
+    return bound;
+}
+
+static RegionBound bound_mandelbox(glm::vec3 lo, glm::vec3 hi, float order, int maxIterations, bool distance)
+{
+    Interval cx(double(lo.x), double(hi.x));
+    Interval cy(double(lo.y), double(hi.y));
+    Interval cz(double(lo.z), double(hi.z));
+    Interval scale(order);
+    Interval abs_scale(std::abs(order));
+
+    Interval x = cx, y = cy, z = cz;
+    Interval dr(1.0f);
+    for (int i = 0; i < maxIterations; ++i)
+    {
+        Interval rad = vsqrt(x * x + y * y + z * z);
+        if (rad.lo > MANDELBOX_BAILOUT)
+        {
+            RegionBound bound;
+            bound.kind = REGION_ESCAPES;
+            bound.escape_iteration = i;
+            bound.min_distance = float(rad.lo / dr.hi * (1.0 - ROUNDING));
+            return bound;
+        }
+        if (!(rad.hi <= MANDELBOX_BAILOUT))
+        {
+            return RegionBound();
+        }
+
+        x = box_fold(x);
+        y = box_fold(y);
+        z = box_fold(z);
+
+        // Sphere fold: 4 below a radius of 0.5, 1 / rad^2 up to 1, and 1 beyond, over the pieces rad reaches
+        Interval fold(-INF, -INF);
+        if (rad.lo < 0.5)
+        {
+            fold = Interval(4.0f);
+        }
+        if (rad.lo < 1.0 && rad.hi >= 0.5)
+        {
+            double a = std::max(rad.lo, 0.5), b = std::min(rad.hi, 1.0);
+            Interval inverse = rounded(1.0 / (b * b), 1.0 / (a * a));
+            fold = fold.lo == -INF ? inverse : hull(fold, inverse);
+        }
+        if (rad.hi >= 1.0)
+        {
+            fold = fold.lo == -INF ? Interval(1.0f) : hull(fold, Interval(1.0f));
+        }
+
+        x = x * fold * scale + cx;
+        y = y * fold * scale + cy;
+        z = z * fold * scale + cz;
+        x = rounded(x.lo, x.hi, ORBIT_SLACK);
+        y = rounded(y.lo, y.hi, ORBIT_SLACK);
+        z = rounded(z.lo, z.hi, ORBIT_SLACK);
+        if (distance)
+        {
+            dr = dr * fold * abs_scale + Interval(1.0f);
+        }
+    }
+
+    RegionBound bound;
+    bound.kind = REGION_INSIDE;
+    return bound;
+}
+
+RegionBound BoundFractalRegion(const FractalParams& params, glm::vec3 lo, glm::vec3 hi, bool distance)
+{
+    int iterations = params.max_iterations > 0 ? params.max_iterations : 1;
+    switch (params.type)
+    {
+    case FRACTAL_MANDELBOX:
+        return bound_mandelbox(lo, hi, params.order, iterations, distance);
+    case FRACTAL_MENGER_SPONGE:
+        return RegionBound();
+    default:
+        break;
+    }
+
+    switch (IntegerOrder(params.order))
+    {
+    case 2: return bound_mandelbulb<2>(lo, hi, iterations, distance);
+    case 3: return bound_mandelbulb<3>(lo, hi, iterations, distance);
+    case 4: return bound_mandelbulb<4>(lo, hi, iterations, distance);
+    case 5: return bound_mandelbulb<5>(lo, hi, iterations, distance);
+    case 6: return bound_mandelbulb<6>(lo, hi, iterations, distance);
+    case 7: return bound_mandelbulb<7>(lo, hi, iterations, distance);
+    case 8: return bound_mandelbulb<8>(lo, hi, iterations, distance);
+    case 9: return bound_mandelbulb<9>(lo, hi, iterations, distance);
+    case 10: return bound_mandelbulb<10>(lo, hi, iterations, distance);
+    case 11: return bound_mandelbulb<11>(lo, hi, iterations, distance);
+    case 12: return bound_mandelbulb<12>(lo, hi, iterations, distance);
+    case 13: return bound_mandelbulb<13>(lo, hi, iterations, distance);
+    case 14: return bound_mandelbulb<14>(lo, hi, iterations, distance);
+    case 15: return bound_mandelbulb<15>(lo, hi, iterations, distance);
+    case 16: return bound_mandelbulb<16>(lo, hi, iterations, distance);
+    default: return bound_polar_mandelbulb(lo, hi, params.order, iterations, distance);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Fractal.h"
+
+#include <glm/glm.hpp>
+
+// Conservative bounds on the escape-time kernels over a whole box of fractal space. Every
+// operation of an iteration is done on ranges instead of single values (interval arithmetic),
+// rounded outwards by more than a float rounding, so the ranges contain the orbit the float
+// kernels in Fractal.cpp and FractalSimd.h compute for every point of the box. A box whose orbits
+// all escape at the same iteration, or none of whose orbits escape, has one density everywhere.
+//
+// The ranges grow with every iteration, so proofs only come through for boxes that are clearly
+// outside the fractal or deep inside it. Boxes that straddle the surface are never proven.
+
+enum RegionKind
+{
+    REGION_UNKNOWN = 0,
+    REGION_ESCAPES = 1,     // every orbit escapes at escape_iteration
+    REGION_INSIDE = 2       // no orbit escapes within max_iterations
+};
+
+struct RegionBound
+{
+    int kind = REGION_UNKNOWN;
+    int escape_iteration = 0;
+    float min_distance = 0.0f;  // lower bound on FractalDistance() over the box, for REGION_ESCAPES
+};
+
+// Bounds params over the points of the box [lo, hi]. Integer order Mandelbulbs track every
+// coordinate, fractional orders only the radius of the orbit. min_distance is only worked out
+// with distance set. The Menger sponge is always REGION_UNKNOWN.
+RegionBound BoundFractalRegion(const FractalParams& params, glm::vec3 lo, glm::vec3 hi, bool distance);
@@ -0,0 +1,152 @@
+#include "FractalSimd.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRACTALS_X86 1
+#endif
+
+#ifdef FRACTALS_X86
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; ++i) regs[i] = (unsigned int)info[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef FRACTALS_X86
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    if (regs[0] < 7)
+    {
+        return SIMD_SCALAR;
+    }
+
+    cpuid(1, 0, regs);
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    bool fma = (regs[2] & (1u << 12)) != 0;
+    if (!osxsave || !avx || !fma)
+    {
+        return SIMD_SCALAR;
+    }
+
+    unsigned long long xcr0 = xgetbv0();
+    bool ymm_state = (xcr0 & 0x06) == 0x06;
+    bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    bool avx2 = (regs[1] & (1u << 5)) != 0;
+    bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+    if (avx512f && zmm_state)
+    {
+        return SIMD_AVX512;
+    }
+    if (avx2 && ymm_state)
+    {
+        return SIMD_AVX2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* SimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX512: return "AVX-512";
+    case SIMD_AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+static std::atomic<int> active_level{ -1 };
+
+void SetSimdLevel(SimdLevel level)
+{
+    SimdLevel supported = DetectSimdLevel();
+    active_level = level < supported ? level : supported;
+}
+
+SimdLevel ActiveSimdLevel()
+{
+    int level = active_level;
+    if (level < 0)
+    {
+        level = DetectSimdLevel();
+        active_level = level;
+    }
+    return (SimdLevel)level;
+}
+
+void FractalDensityBatch(const FractalParams& params, const PointBatch& batch, float* density)
+{
+    switch (ActiveSimdLevel())
+    {
+    case SIMD_AVX512:
+        FractalDensityBatchAvx512(params, batch, density);
+        break;
+    case SIMD_AVX2:
+        FractalDensityBatchAvx2(params, batch, density);
+        break;
+    default:
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            density[i] = FractalDensity(params, glm::vec3(batch.x[i], batch.y[i], batch.z[i]));
+        }
+        break;
+    }
+}
+
+void MengerSpongeDistanceBatch(const PointBatch& batch, int maxIterations, float* distance)
+{
+    for (size_t i = 0; i < batch.count; ++i)
+    {
+        distance[i] = MengerSpongeDistance(glm::vec3(batch.x[i], batch.y[i], batch.z[i]), maxIterations);
+    }
+}
+
+void FractalDistanceBatch(const FractalParams& params, const PointBatch& batch, float* distance)
+{
+    switch (ActiveSimdLevel())
+    {
+    case SIMD_AVX512:
+        FractalDistanceBatchAvx512(params, batch, distance);
+        break;
+    case SIMD_AVX2:
+        FractalDistanceBatchAvx2(params, batch, distance);
+        break;
+    default:
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            distance[i] = FractalDistance(params, glm::vec3(batch.x[i], batch.y[i], batch.z[i]));
+        }
+        break;
+    }
+}
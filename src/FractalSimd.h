@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Fractal.h"
+
+#include <cstddef>
+
+// Vectorized versions of the kernels in Fractal.h, 8 lanes wide on AVX2 and 16 on AVX-512.
+// The widest kernel the CPU supports is picked at runtime.
+
+enum SimdLevel
+{
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2
+};
+
+// Structure-of-arrays batch of points in fractal space
+struct PointBatch
+{
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    size_t count = 0;
+};
+
+// Best instruction set supported by both the CPU and the OS
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(SimdLevel level);
+
+// Caps the level used by FractalDensityBatch, e.g. to compare kernels. Clamped to what the CPU supports.
+void SetSimdLevel(SimdLevel level);
+SimdLevel ActiveSimdLevel();
+
+// Writes the density of every point in the batch to density[0 .. count).
+// Lanes whose orbit finishes early are refilled with the next point straight away,
+// so a batch costs about as much as its total iteration count rather than its slowest point per vector.
+void FractalDensityBatch(const FractalParams& params, const PointBatch& batch, float* density);
+
+// Same for FractalDistance(), estimates in fractal space
+void FractalDistanceBatch(const FractalParams& params, const PointBatch& batch, float* distance);
+
+// Per-instruction-set entry points, only call them when the CPU supports the instruction set
+void FractalDensityBatchAvx2(const FractalParams& params, const PointBatch& batch, float* density);
+void FractalDensityBatchAvx512(const FractalParams& params, const PointBatch& batch, float* density);
+void FractalDistanceBatchAvx2(const FractalParams& params, const PointBatch& batch, float* distance);
+void FractalDistanceBatchAvx512(const FractalParams& params, const PointBatch& batch, float* distance);
+
+// Scalar MengerSpongeDistance() over a batch, for the SIMD kernels. Compiled without any
+// instruction set flags, so no AVX copy of the scalar code or of glm ends up in the link.
+void MengerSpongeDistanceBatch(const PointBatch& batch, int maxIterations, float* distance);
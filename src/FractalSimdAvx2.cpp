@@ -0,0 +1,86 @@
+// 8-wide AVX2 fractal kernels. Built with /arch:AVX2 in Fractals.vcxproj,
+// only called after DetectSimdLevel() has confirmed AVX2 and FMA support.
+#include "FractalSimd.h"
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace
+{
+    struct Mask8
+    {
+        __m256 v;
+    };
+
+    struct Float8
+    {
+        static const int width = 8;
+        using Mask = Mask8;
+
+        __m256 v;
+
+        Float8() : v(_mm256_setzero_ps()) {}
+        Float8(__m256 x) : v(x) {}
+        Float8(float x) : v(_mm256_set1_ps(x)) {}
+    };
+
+    inline Float8 load(const float* p) { return _mm256_load_ps(p); }
+    inline void store(float* p, Float8 a) { _mm256_store_ps(p, a.v); }
+
+    inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+    inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.v, b.v); }
+    inline Float8 operator-(Float8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+    inline Mask8 operator<(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Mask8 operator>(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Mask8 operator>=(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    inline Mask8 operator==(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+
+    inline Mask8 operator&(Mask8 a, Mask8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline Mask8 operator|(Mask8 a, Mask8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+    inline Mask8 operator!(Mask8 a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+
+    inline Float8 vsqrt(Float8 a) { return _mm256_sqrt_ps(a.v); }
+    inline Float8 vabs(Float8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+    inline Float8 vmin(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+    inline Float8 vmax(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+    inline Float8 vfloor(Float8 a) { return _mm256_floor_ps(a.v); }
+    inline Float8 select(Mask8 m, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+    inline unsigned int movemask(Mask8 m) { return (unsigned int)_mm256_movemask_ps(m.v); }
+
+    inline Float8 frexp_exponent(Float8 a)
+    {
+        __m256i bits = _mm256_castps_si256(a.v);
+        __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126));
+        return _mm256_cvtepi32_ps(e);
+    }
+
+    inline Float8 frexp_mantissa(Float8 a)
+    {
+        __m256i bits = _mm256_and_si256(_mm256_castps_si256(a.v), _mm256_set1_epi32(0x807fffff));
+        return _mm256_castsi256_ps(_mm256_or_si256(bits, _mm256_set1_epi32(0x3f000000)));
+    }
+
+    inline Float8 pow2i(Float8 n)
+    {
+        __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+}
+
+#include "FractalSimdKernels.h"
+
+void FractalDensityBatchAvx2(const FractalParams& params, const PointBatch& batch, float* density)
+{
+    DensityBatch<Float8>(params, batch, density);
+}
+
+void FractalDistanceBatchAvx2(const FractalParams& params, const PointBatch& batch, float* distance)
+{
+    DistanceBatch<Float8>(params, batch, distance);
+}
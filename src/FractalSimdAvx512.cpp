@@ -0,0 +1,92 @@
+// 16-wide AVX-512 fractal kernels. Built with /arch:AVX512 in Fractals.vcxproj,
+// only called after DetectSimdLevel() has confirmed AVX-512F support.
+#include "FractalSimd.h"
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) && !defined(__AVX512F__)
+#pragma GCC target("avx512f")
+#endif
+
+namespace
+{
+    struct Mask16
+    {
+        __mmask16 m;
+    };
+
+    struct Float16
+    {
+        static const int width = 16;
+        using Mask = Mask16;
+
+        __m512 v;
+
+        Float16() : v(_mm512_setzero_ps()) {}
+        Float16(__m512 x) : v(x) {}
+        Float16(float x) : v(_mm512_set1_ps(x)) {}
+    };
+
+    inline Float16 load(const float* p) { return _mm512_load_ps(p); }
+    inline void store(float* p, Float16 a) { _mm512_store_ps(p, a.v); }
+
+    inline Float16 operator+(Float16 a, Float16 b) { return _mm512_add_ps(a.v, b.v); }
+    inline Float16 operator-(Float16 a, Float16 b) { return _mm512_sub_ps(a.v, b.v); }
+    inline Float16 operator*(Float16 a, Float16 b) { return _mm512_mul_ps(a.v, b.v); }
+    inline Float16 operator/(Float16 a, Float16 b) { return _mm512_div_ps(a.v, b.v); }
+    inline Float16 operator-(Float16 a)
+    {
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x80000000)));
+    }
+
+    inline Mask16 operator<(Float16 a, Float16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Mask16 operator>(Float16 a, Float16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Mask16 operator>=(Float16 a, Float16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+    inline Mask16 operator==(Float16 a, Float16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+
+    inline Mask16 operator&(Mask16 a, Mask16 b) { return { (__mmask16)(a.m & b.m) }; }
+    inline Mask16 operator|(Mask16 a, Mask16 b) { return { (__mmask16)(a.m | b.m) }; }
+    inline Mask16 operator!(Mask16 a) { return { (__mmask16)~a.m }; }
+
+    inline Float16 vsqrt(Float16 a) { return _mm512_sqrt_ps(a.v); }
+    inline Float16 vabs(Float16 a)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x7fffffff)));
+    }
+    inline Float16 vmin(Float16 a, Float16 b) { return _mm512_min_ps(a.v, b.v); }
+    inline Float16 vmax(Float16 a, Float16 b) { return _mm512_max_ps(a.v, b.v); }
+    inline Float16 vfloor(Float16 a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    inline Float16 select(Mask16 m, Float16 a, Float16 b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+    inline unsigned int movemask(Mask16 m) { return (unsigned int)m.m; }
+
+    inline Float16 frexp_exponent(Float16 a)
+    {
+        __m512i bits = _mm512_castps_si512(a.v);
+        __m512i e = _mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126));
+        return _mm512_cvtepi32_ps(e);
+    }
+
+    inline Float16 frexp_mantissa(Float16 a)
+    {
+        __m512i bits = _mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x807fffff));
+        return _mm512_castsi512_ps(_mm512_or_si512(bits, _mm512_set1_epi32(0x3f000000)));
+    }
+
+    inline Float16 pow2i(Float16 n)
+    {
+        __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n.v), _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+    }
+}
+
+#include "FractalSimdKernels.h"
+
+void FractalDensityBatchAvx512(const FractalParams& params, const PointBatch& batch, float* density)
+{
+    DensityBatch<Float16>(params, batch, density);
+}
+
+void FractalDistanceBatchAvx512(const FractalParams& params, const PointBatch& batch, float* distance)
+{
+    DistanceBatch<Float16>(params, batch, distance);
+}
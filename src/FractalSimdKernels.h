@@ -0,0 +1,572 @@
+#pragma once
+
+// Width-independent SIMD fractal kernels, included by the per-instruction-set translation units.
+//
+// Each including file defines, inside an anonymous namespace, a float vector type V with a
+// matching mask type V::Mask and:
+//   V::width, V(float), load(const float*), store(float*, V)
+//   + - * / and unary -, comparisons returning V::Mask, & | ! on masks
+//   vsqrt, vabs, vmin, vmax, vfloor, select(mask, a, b), movemask(mask)
+//   frexp_mantissa / frexp_exponent (mantissa in [0.5, 1)) and pow2i (2^n for integral n)
+//
+// Everything here is a template on V so that each translation unit gets its own copy compiled
+// for its own instruction set. Don't add non-template code or standard library calls here.
+
+#include "FractalSimd.h"
+#include "Triplex.h"
+
+// Polynomial approximations from the Cephes single precision math library
+
+template<class V>
+V vlog(V x)
+{
+    V e = frexp_exponent(x);
+    V m = frexp_mantissa(x);
+
+    auto small = m < V(0.707106781186547524f);
+    e = select(small, e - V(1.0f), e);
+    m = select(small, m + m - V(1.0f), m - V(1.0f));
+
+    V z = m * m;
+    V y = V(7.0376836292E-2f);
+    y = y * m + V(-1.1514610310E-1f);
+    y = y * m + V(1.1676998740E-1f);
+    y = y * m + V(-1.2420140846E-1f);
+    y = y * m + V(1.4249322787E-1f);
+    y = y * m + V(-1.6668057665E-1f);
+    y = y * m + V(2.0000714765E-1f);
+    y = y * m + V(-2.4999993993E-1f);
+    y = y * m + V(3.3333331174E-1f);
+    y = y * m * z;
+    y = y + e * V(-2.12194440e-4f);
+    y = y - V(0.5f) * z;
+    return m + y + e * V(0.693359375f);
+}
+
+template<class V>
+V vexp(V x)
+{
+    x = vmin(vmax(x, V(-88.3762626647949f)), V(88.3762626647949f));
+
+    V fx = vfloor(x * V(1.44269504088896341f) + V(0.5f));
+    x = x - fx * V(0.693359375f);
+    x = x - fx * V(-2.12194440e-4f);
+
+    V z = x * x;
+    V y = V(1.9875691500E-4f);
+    y = y * x + V(1.3981999507E-3f);
+    y = y * x + V(8.3334519073E-3f);
+    y = y * x + V(4.1665795894E-2f);
+    y = y * x + V(1.6666665459E-1f);
+    y = y * x + V(5.0000001201E-1f);
+    y = y * z + x + V(1.0f);
+    return y * pow2i(fx);
+}
+
+// x^p for x >= 0
+template<class V>
+V vpow(V x, V p)
+{
+    return select(x > V(0.0f), vexp(p * vlog(x)), V(0.0f));
+}
+
+template<class V>
+void vsincos(V x, V& s, V& c)
+{
+    auto negative = x < V(0.0f);
+    x = vabs(x);
+
+    // Octant j, rounded up to an even number, and its position in the 8-octant cycle
+    V j = V(2.0f) * vfloor((vfloor(x * V(1.27323954473516f)) + V(1.0f)) * V(0.5f));
+    V q = j - V(8.0f) * vfloor(j * V(0.125f));
+
+    x = x - j * V(0.78515625f);
+    x = x - j * V(2.4187564849853515625e-4f);
+    x = x - j * V(3.77489497744594108e-8f);
+
+    V z = x * x;
+    V cos_poly = V(2.443315711809948E-005f);
+    cos_poly = cos_poly * z + V(-1.388731625493765E-003f);
+    cos_poly = cos_poly * z + V(4.166664568298827E-002f);
+    cos_poly = cos_poly * z * z - V(0.5f) * z + V(1.0f);
+
+    V sin_poly = V(-1.9515295891E-4f);
+    sin_poly = sin_poly * z + V(8.3321608736E-3f);
+    sin_poly = sin_poly * z + V(-1.6666654611E-1f);
+    sin_poly = sin_poly * z * x + x;
+
+    auto swap = (q == V(2.0f)) | (q == V(6.0f));
+    s = select(swap, cos_poly, sin_poly);
+    c = select(swap, sin_poly, cos_poly);
+
+    auto sin_flip = (q >= V(4.0f));
+    s = select(sin_flip, -s, s);
+    s = select(negative, -s, s);
+
+    auto cos_flip = (q == V(2.0f)) | (q == V(4.0f));
+    c = select(cos_flip, -c, c);
+}
+
+template<class V>
+V vasin(V x)
+{
+    auto negative = x < V(0.0f);
+    V a = vabs(x);
+
+    auto large = a > V(0.5f);
+    V z = select(large, V(0.5f) * (V(1.0f) - a), a * a);
+    V t = select(large, vsqrt(z), a);
+
+    V p = V(4.2163199048E-2f);
+    p = p * z + V(2.4181311049E-2f);
+    p = p * z + V(4.5470025998E-2f);
+    p = p * z + V(7.4953002686E-2f);
+    p = p * z + V(1.6666752422E-1f);
+    p = p * z * t + t;
+
+    p = select(large, V(1.5707963267948966f) - (p + p), p);
+    return select(negative, -p, p);
+}
+
+template<class V>
+V vacos(V x)
+{
+    return V(1.5707963267948966f) - vasin(x);
+}
+
+template<class V>
+V vatan(V x)
+{
+    auto negative = x < V(0.0f);
+    x = vabs(x);
+
+    auto high = x > V(2.414213562373095f);
+    auto mid = (!high) & (x > V(0.4142135623730950f));
+    V y = select(high, V(1.5707963267948966f), select(mid, V(0.78539816339744831f), V(0.0f)));
+    x = select(high, V(-1.0f) / x, select(mid, (x - V(1.0f)) / (x + V(1.0f)), x));
+
+    V z = x * x;
+    V p = V(8.05374449538e-2f);
+    p = p * z + V(-1.38776856032E-1f);
+    p = p * z + V(1.99777106478E-1f);
+    p = p * z + V(-3.33329491539E-1f);
+    p = p * z * x + x + y;
+
+    return select(negative, -p, p);
+}
+
+template<class V>
+V vatan2(V y, V x)
+{
+    V base = vatan(y / x);
+    V pi = V(3.14159265358979f);
+    V result = select(x < V(0.0f), select(y < V(0.0f), base - pi, base + pi), base);
+
+    auto vertical = x == V(0.0f);
+    V axis = select(y > V(0.0f), V(1.5707963267948966f), select(y < V(0.0f), V(-1.5707963267948966f), V(0.0f)));
+    return select(vertical, axis, result);
+}
+
+// Kernels. Each one keeps its per-lane orbit in state_size vectors, the first three of which
+// hold the point being evaluated, and exposes:
+//   init(lanes, lane, x, y, z)  start a new orbit in one lane of the spilled state
+//   step(state)                 advance every lane by one iteration, returns the lanes that finished
+//   result(state)               density of every lane, only read for the finished ones
+// The Distance variants also carry the running derivative dr in state[7] and return distance estimates.
+
+// Mandelbulb interior shortcuts, matching the scalar ones in Fractal.cpp. Points inside the
+// interior ball start one iteration short of max_iterations so they finish after a single step.
+// The orbit check keeps z and the iteration to save it at in s[C..C+3]: a lane that comes back to
+// exactly the saved z cycles forever, so it is finished as if it had run out of iterations.
+template<class V>
+float MandelbulbStartIteration(float x, float y, float z, float interior_radius2, float max_iterations)
+{
+    return x * x + y * y + z * z <= interior_radius2 ? max_iterations - 1.0f : 0.0f;
+}
+
+template<class V, int C>
+void MandelbulbInitCycle(float (*lanes)[V::width], int lane, float x, float y, float z)
+{
+    lanes[C][lane] = x; lanes[C + 1][lane] = y; lanes[C + 2][lane] = z;
+    lanes[C + 3][lane] = 1.0f;
+}
+
+template<class V, int C>
+void MandelbulbCheckCycle(V* s, typename V::Mask escaped, float max_iterations)
+{
+    auto repeated = (!escaped) & (s[3] == s[C]) & (s[4] == s[C + 1]) & (s[5] == s[C + 2]);
+    s[6] = select(repeated, V(max_iterations), s[6]);
+
+    auto save = s[6] == s[C + 3];
+    s[C] = select(save, s[3], s[C]);
+    s[C + 1] = select(save, s[4], s[C + 1]);
+    s[C + 2] = select(save, s[5], s[C + 2]);
+    s[C + 3] = select(save, s[C + 3] + s[C + 3], s[C + 3]);
+}
+
+// 0.5 * log(r) * r / dr for lanes that escaped, 0 for the ones that stayed inside
+template<class V>
+V MandelbulbDistanceEstimate(const V* s, float max_iterations)
+{
+    V r = vsqrt(s[3] * s[3] + s[4] * s[4] + s[5] * s[5]);
+    return select(s[6] < V(max_iterations), V(0.5f) * vlog(r) * r / s[7], V(0.0f));
+}
+
+template<class V, bool Distance = false>
+struct MandelbulbKernel
+{
+    static const int cycle = Distance ? 8 : 7;
+    static const int state_size = cycle + 4; // point xyz, z xyz, iteration, dr, saved z xyz, next save
+
+    float order;
+    float max_iterations;
+    float interior_radius2 = 0.0f;
+
+    void init(float (*lanes)[V::width], int lane, float x, float y, float z) const
+    {
+        lanes[0][lane] = x; lanes[1][lane] = y; lanes[2][lane] = z;
+        lanes[3][lane] = x; lanes[4][lane] = y; lanes[5][lane] = z;
+        lanes[6][lane] = MandelbulbStartIteration<V>(x, y, z, interior_radius2, max_iterations);
+        if constexpr (Distance)
+            lanes[7][lane] = 1.0f;
+        MandelbulbInitCycle<V, cycle>(lanes, lane, x, y, z);
+    }
+
+    typename V::Mask step(V* s) const
+    {
+        V r = vsqrt(s[3] * s[3] + s[4] * s[4] + s[5] * s[5]);
+        auto escaped = r > V(2.0f);
+
+        // Convert to polar coordinates
+        V power = V(order);
+        V theta = vacos(s[5] / r) * power;
+        V phi = vatan2(s[4], s[3]) * power;
+        V zr = vpow(r, power);
+        if constexpr (Distance)
+        {
+            s[7] = select(escaped, s[7], power * vpow(r, power - V(1.0f)) * s[7] + V(1.0f));
+        }
+
+        // Scale and rotate the point, then convert back to Cartesian coordinates
+        V sin_theta, cos_theta, sin_phi, cos_phi;
+        vsincos(theta, sin_theta, cos_theta);
+        vsincos(phi, sin_phi, cos_phi);
+
+        s[3] = select(escaped, s[3], sin_theta * cos_phi * zr + s[0]);
+        s[4] = select(escaped, s[4], sin_phi * sin_theta * zr + s[1]);
+        s[5] = select(escaped, s[5], cos_theta * zr + s[2]);
+        s[6] = select(escaped, s[6], s[6] + V(1.0f));
+        MandelbulbCheckCycle<V, cycle>(s, escaped, max_iterations);
+
+        return escaped | (s[6] >= V(max_iterations));
+    }
+
+    V result(const V* s) const
+    {
+        if constexpr (Distance)
+            return MandelbulbDistanceEstimate(s, max_iterations);
+        else
+            return s[6] / V(max_iterations);
+    }
+};
+
+// Integer orders, same iteration with the trig-free triplex power
+template<class V, int Order, bool Distance = false>
+struct MandelbulbIntegerKernel
+{
+    static const int cycle = Distance ? 8 : 7;
+    static const int state_size = cycle + 4; // point xyz, z xyz, iteration, dr, saved z xyz, next save
+
+    float max_iterations;
+    float interior_radius2 = 0.0f;
+
+    void init(float (*lanes)[V::width], int lane, float x, float y, float z) const
+    {
+        lanes[0][lane] = x; lanes[1][lane] = y; lanes[2][lane] = z;
+        lanes[3][lane] = x; lanes[4][lane] = y; lanes[5][lane] = z;
+        lanes[6][lane] = MandelbulbStartIteration<V>(x, y, z, interior_radius2, max_iterations);
+        if constexpr (Distance)
+            lanes[7][lane] = 1.0f;
+        MandelbulbInitCycle<V, cycle>(lanes, lane, x, y, z);
+    }
+
+    typename V::Mask step(V* s) const
+    {
+        V r2 = s[3] * s[3] + s[4] * s[4] + s[5] * s[5];
+        auto escaped = r2 > V(4.0f);
+        if constexpr (Distance)
+        {
+            s[7] = select(escaped, s[7], V(float(Order)) * IntegerPower<Order - 1>(vsqrt(r2)) * s[7] + V(1.0f));
+        }
+
+        V x = s[3], y = s[4], z = s[5];
+        TriplexPower<Order>(x, y, z);
+
+        s[3] = select(escaped, s[3], x + s[0]);
+        s[4] = select(escaped, s[4], y + s[1]);
+        s[5] = select(escaped, s[5], z + s[2]);
+        s[6] = select(escaped, s[6], s[6] + V(1.0f));
+        MandelbulbCheckCycle<V, cycle>(s, escaped, max_iterations);
+
+        return escaped | (s[6] >= V(max_iterations));
+    }
+
+    V result(const V* s) const
+    {
+        if constexpr (Distance)
+            return MandelbulbDistanceEstimate(s, max_iterations);
+        else
+            return s[6] / V(max_iterations);
+    }
+};
+
+template<class V, bool Distance = false>
+struct MandelboxKernel
+{
+    static const int state_size = Distance ? 8 : 7; // point xyz, zeta xyz, iteration, dr
+
+    float order;
+    float max_iterations;
+
+    void init(float (*lanes)[V::width], int lane, float x, float y, float z) const
+    {
+        lanes[0][lane] = x; lanes[1][lane] = y; lanes[2][lane] = z;
+        lanes[3][lane] = x; lanes[4][lane] = y; lanes[5][lane] = z;
+        lanes[6][lane] = 0.0f;
+        if constexpr (Distance)
+            lanes[7][lane] = 1.0f;
+    }
+
+    typename V::Mask step(V* s) const
+    {
+        V rad = vsqrt(s[3] * s[3] + s[4] * s[4] + s[5] * s[5]);
+        auto escaped = rad > V(MANDELBOX_BAILOUT);
+
+        // Box fold
+        V zx = vmin(vmax(s[3], V(-1.0f)), V(1.0f)) * V(2.0f) - s[3];
+        V zy = vmin(vmax(s[4], V(-1.0f)), V(1.0f)) * V(2.0f) - s[4];
+        V zz = vmin(vmax(s[5], V(-1.0f)), V(1.0f)) * V(2.0f) - s[5];
+
+        // Sphere fold
+        V fold = select(rad < V(0.5f), V(4.0f), select(rad < V(1.0f), V(1.0f) / (rad * rad), V(1.0f)));
+
+        V power = V(order);
+        zx = zx * fold * power + s[0];
+        zy = zy * fold * power + s[1];
+        zz = zz * fold * power + s[2];
+
+        s[3] = select(escaped, s[3], zx);
+        s[4] = select(escaped, s[4], zy);
+        s[5] = select(escaped, s[5], zz);
+        s[6] = select(escaped, s[6], s[6] + V(1.0f));
+        if constexpr (Distance)
+        {
+            s[7] = select(escaped, s[7], s[7] * fold * vabs(power) + V(1.0f));
+        }
+
+        return escaped | (s[6] >= V(max_iterations));
+    }
+
+    V result(const V* s) const
+    {
+        if constexpr (Distance)
+        {
+            V rad = vsqrt(s[3] * s[3] + s[4] * s[4] + s[5] * s[5]);
+            return select(s[6] < V(max_iterations), rad / vabs(s[7]), V(0.0f));
+        }
+        else
+            return s[6] / V(max_iterations);
+    }
+};
+
+template<class V>
+typename V::Mask in_middle_third(V v)
+{
+    return (v > V(1.0f / 3.0f)) & (v < V(2.0f / 3.0f));
+}
+
+template<class V>
+struct MengerSpongeKernel
+{
+    static const int state_size = 6; // position xyz, scale, iteration, hole
+
+    float max_iterations;
+
+    void init(float (*lanes)[V::width], int lane, float x, float y, float z) const
+    {
+        lanes[0][lane] = x; lanes[1][lane] = y; lanes[2][lane] = z;
+        lanes[3][lane] = 1.0f;
+        lanes[4][lane] = 0.0f;
+        lanes[5][lane] = 0.0f;
+    }
+
+    typename V::Mask step(V* s) const
+    {
+        // Fold space back onto itself, mod() as in GLSL
+        V scale = s[3];
+        V half = V(0.5f) * scale;
+        V px = s[0] - scale * vfloor(s[0] / scale) - half;
+        V py = s[1] - scale * vfloor(s[1] / scale) - half;
+        V pz = s[2] - scale * vfloor(s[2] / scale) - half;
+
+        auto divide = scale > V(0.01f);
+        px = select(divide, vabs(px) / scale, px);
+        py = select(divide, vabs(py) / scale, py);
+        pz = select(divide, vabs(pz) / scale, pz);
+
+        auto x = in_middle_third(px);
+        auto y = in_middle_third(py);
+        auto z = in_middle_third(pz);
+        auto hole = (x & (y | z)) | (y & z);
+
+        s[0] = px;
+        s[1] = py;
+        s[2] = pz;
+        s[3] = scale / V(3.0f);
+        s[4] = s[4] + V(1.0f);
+        s[5] = select(hole, V(1.0f), V(0.0f));
+
+        return hole | (s[4] >= V(max_iterations));
+    }
+
+    V result(const V* s) const
+    {
+        return select(s[5] > V(0.5f), V(0.0f), V(1.0f));
+    }
+};
+
+// Runs kernel over the whole batch. Whenever a lane finishes, its result is written out and the
+// lane is refilled with the next unprocessed point, so all lanes stay busy until the batch runs dry.
+template<class V, class Kernel>
+void RunBatch(const Kernel& kernel, const PointBatch& batch, float* out)
+{
+    const int W = V::width;
+    const int S = Kernel::state_size;
+
+    alignas(64) float lanes[S][W];
+    alignas(64) float results[W];
+    long long index[W];
+    unsigned int live = 0;
+    size_t next = 0;
+
+    for (int l = 0; l < W; ++l)
+    {
+        if (next < batch.count)
+        {
+            kernel.init(lanes, l, batch.x[next], batch.y[next], batch.z[next]);
+            index[l] = (long long)next++;
+            live |= 1u << l;
+        }
+        else
+        {
+            // Idle lane, start it far outside so it has nothing to compute
+            kernel.init(lanes, l, 4.0f, 4.0f, 4.0f);
+            index[l] = -1;
+        }
+    }
+
+    V state[S];
+    for (int i = 0; i < S; ++i)
+    {
+        state[i] = load(lanes[i]);
+    }
+
+    while (live != 0)
+    {
+        unsigned int done = movemask(kernel.step(state)) & live;
+        if (done == 0)
+        {
+            continue;
+        }
+
+        store(results, kernel.result(state));
+        for (int i = 0; i < S; ++i)
+        {
+            store(lanes[i], state[i]);
+        }
+        for (int l = 0; l < W; ++l)
+        {
+            if ((done & (1u << l)) == 0)
+            {
+                continue;
+            }
+            out[index[l]] = results[l];
+            if (next < batch.count)
+            {
+                kernel.init(lanes, l, batch.x[next], batch.y[next], batch.z[next]);
+                index[l] = (long long)next++;
+            }
+            else
+            {
+                live &= ~(1u << l);
+            }
+        }
+        for (int i = 0; i < S; ++i)
+        {
+            state[i] = load(lanes[i]);
+        }
+    }
+}
+
+template<class V, bool Distance>
+void MandelbulbBatch(float order, float max_iterations, const PointBatch& batch, float* out)
+{
+    float interior_radius = MandelbulbInteriorRadius(order);
+    float interior_radius2 = interior_radius * interior_radius;
+    switch (IntegerOrder(order))
+    {
+    case 2: RunBatch<V>(MandelbulbIntegerKernel<V, 2, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 3: RunBatch<V>(MandelbulbIntegerKernel<V, 3, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 4: RunBatch<V>(MandelbulbIntegerKernel<V, 4, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 5: RunBatch<V>(MandelbulbIntegerKernel<V, 5, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 6: RunBatch<V>(MandelbulbIntegerKernel<V, 6, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 7: RunBatch<V>(MandelbulbIntegerKernel<V, 7, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 8: RunBatch<V>(MandelbulbIntegerKernel<V, 8, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 9: RunBatch<V>(MandelbulbIntegerKernel<V, 9, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 10: RunBatch<V>(MandelbulbIntegerKernel<V, 10, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 11: RunBatch<V>(MandelbulbIntegerKernel<V, 11, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 12: RunBatch<V>(MandelbulbIntegerKernel<V, 12, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 13: RunBatch<V>(MandelbulbIntegerKernel<V, 13, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 14: RunBatch<V>(MandelbulbIntegerKernel<V, 14, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 15: RunBatch<V>(MandelbulbIntegerKernel<V, 15, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    case 16: RunBatch<V>(MandelbulbIntegerKernel<V, 16, Distance>{ max_iterations, interior_radius2 }, batch, out); break;
+    default: RunBatch<V>(MandelbulbKernel<V, Distance>{ order, max_iterations, interior_radius2 }, batch, out); break;
+    }
+}
+
+template<class V>
+void DensityBatch(const FractalParams& params, const PointBatch& batch, float* density)
+{
+    float max_iterations = float(params.max_iterations > 0 ? params.max_iterations : 1);
+    switch (params.type)
+    {
+    case FRACTAL_MANDELBOX:
+        RunBatch<V>(MandelboxKernel<V>{ params.order, max_iterations }, batch, density);
+        break;
+    case FRACTAL_MENGER_SPONGE:
+        RunBatch<V>(MengerSpongeKernel<V>{ max_iterations }, batch, density);
+        break;
+    default:
+        MandelbulbBatch<V, false>(params.order, max_iterations, batch, density);
+        break;
+    }
+}
+
+template<class V>
+void DistanceBatch(const FractalParams& params, const PointBatch& batch, float* distance)
+{
+    float max_iterations = float(params.max_iterations > 0 ? params.max_iterations : 1);
+    switch (params.type)
+    {
+    case FRACTAL_MANDELBOX:
+        RunBatch<V>(MandelboxKernel<V, true>{ params.order, max_iterations }, batch, distance);
+        break;
+    case FRACTAL_MENGER_SPONGE:
+        // Cheap enough that the scalar version is fine, out of line in the baseline translation unit
+        MengerSpongeDistanceBatch(batch, params.max_iterations, distance);
+        break;
+    default:
+        MandelbulbBatch<V, true>(params.order, max_iterations, batch, distance);
+        break;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The std140 uniform block FrameUniforms of shaders/fractals_fs.glsl, member for member. Every
+// vec3 is followed by a scalar that fills the rest of its 16 bytes, so plain glm members line up
+// with std140 without padding. The layout is checked against the linked shader's reflection.
+struct FrameUniforms
+{
+    glm::mat4 inv_P = glm::mat4(1.0f);
+    glm::mat4 inv_V = glm::mat4(1.0f);
+    glm::vec3 cam_pos = glm::vec3(0.0f);
+    float order = 0.0f;
+    glm::vec3 bound_center = glm::vec3(0.0f);
+    float bound_radius = 0.0f;
+    glm::vec3 color1 = glm::vec3(0.0f);
+    int range_levels = 0;
+    glm::vec3 color2 = glm::vec3(0.0f);
+    float range_cell_size = 0.0f;
+    glm::vec3 color3 = glm::vec3(0.0f);
+    int max_iterations = 0;
+    glm::vec3 color4 = glm::vec3(0.0f);
+    int fractal_type = 0;
+    glm::vec3 color5 = glm::vec3(0.0f);
+    int render_mode = 0;
+    glm::vec3 fractal_min = glm::vec3(0.0f);
+    int window_width = 0;
+    glm::vec3 fractal_extent = glm::vec3(1.0f);
+    int window_height = 0;
+};
+
+static_assert(sizeof(FrameUniforms) == 272, "FrameUniforms has to match the std140 layout of the shader block");
+
+// render_mode for sphere tracing the fractal's distance estimate directly, without a volume.
+// Modes below it are the BakeField of the volume being rendered.
+const int RENDER_DIRECT_DISTANCE = 2;
+
+// Uniform buffer binding the block is declared with
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
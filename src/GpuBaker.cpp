@@ -0,0 +1,191 @@
+#include "GpuBaker.h"
+
+#include "InitShader.h"
+#include "Triplex.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+// Work group sides of the two shaders
+static const int RANGE_GROUP_SIZE = 4;
+
+static GLuint load_compute_shader(const std::string& path)
+{
+    GLuint program = InitShader(path.c_str());
+    return program == GLuint(-1) ? 0 : program;
+}
+
+GpuBaker::GpuBaker(const std::string& shaderDir)
+{
+    m_bakeProgram = load_compute_shader(shaderDir + "fractals_bake_cs.glsl");
+    m_rangeProgram = load_compute_shader(shaderDir + "fractals_range_cs.glsl");
+}
+
+GpuBaker::~GpuBaker()
+{
+    deleteTextures();
+    if (m_bakeProgram != 0)
+    {
+        DeleteShaderProgram(m_bakeProgram);
+    }
+    if (m_rangeProgram != 0)
+    {
+        DeleteShaderProgram(m_rangeProgram);
+    }
+}
+
+void GpuBaker::deleteTextures()
+{
+    if (m_texture != 0)
+    {
+        glDeleteTextures(1, &m_texture);
+    }
+    if (m_rangeTexture != 0)
+    {
+        glDeleteTextures(1, &m_rangeTexture);
+    }
+    m_texture = 0;
+    m_rangeTexture = 0;
+}
+
+void GpuBaker::cancel()
+{
+    deleteTextures();
+    m_finished = false;
+}
+
+void GpuBaker::begin(const BakeSettings& settings, float border)
+{
+    cancel();
+    m_settings = settings;
+    m_nextLayer = 0;
+
+    // Same sampling as the textures VolumeUploader streams into, immutable so it can be bound as an image
+    int gridSize = settings.resolution;
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    float border_color[4] = { border, border, border, border };
+    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, border_color);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_R32F, gridSize, gridSize, gridSize);
+
+    // Level 0 padded to a power of two, like MinMaxPyramid
+    int bricks = (gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+    int baseSize = 1;
+    m_rangeLevels = 1;
+    while (baseSize < bricks)
+    {
+        baseSize *= 2;
+        m_rangeLevels++;
+    }
+    glGenTextures(1, &m_rangeTexture);
+    glBindTexture(GL_TEXTURE_3D, m_rangeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, m_rangeLevels - 1);
+    glTexStorage3D(GL_TEXTURE_3D, m_rangeLevels, GL_RG32F, baseSize, baseSize, baseSize);
+}
+
+bool GpuBaker::pump(int maxLayers)
+{
+    if (!busy())
+    {
+        return false;
+    }
+
+    const BakeSettings& settings = m_settings;
+    int bricks = (settings.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    int layers = std::min(maxLayers, bricks - m_nextLayer);
+    if (layers > 0)
+    {
+        const FractalParams& fractal = settings.fractal;
+        glm::vec3 extent = settings.bounds_max - settings.bounds_min;
+        glm::vec3 voxel_size = extent / float(settings.resolution);
+        float interior = fractal.type == FRACTAL_MANDELBULB ? MandelbulbInteriorRadius(fractal.order) : 0.0f;
+
+        const ShaderReflection& bake = GetShaderReflection(m_bakeProgram);
+        glUseProgram(m_bakeProgram);
+        glUniform1i(bake.location("first_layer"), m_nextLayer);
+        glUniform1i(bake.location("resolution"), settings.resolution);
+        glUniform3fv(bake.location("bounds_min"), 1, glm::value_ptr(settings.bounds_min));
+        glUniform3fv(bake.location("voxel_size"), 1, glm::value_ptr(voxel_size));
+        glUniform1i(bake.location("fractal_type"), fractal.type);
+        glUniform1f(bake.location("order"), fractal.order);
+        glUniform1i(bake.location("max_iterations"), fractal.max_iterations);
+        glUniform1i(bake.location("integer_order"), IntegerOrder(fractal.order));
+        glUniform1f(bake.location("interior_radius2"), interior * interior);
+        glUniform1i(bake.location("field"), settings.field);
+        glUniform1f(bake.location("distance_scale"), 1.0f / std::min(std::min(extent.x, extent.y), extent.z));
+        glUniform1f(bake.location("distance_band"), settings.distance_band);
+
+        glBindImageTexture(0, m_texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute(bricks, bricks, layers);
+        m_nextLayer += layers;
+
+        // Hands the layers to the GPU now rather than when the frame is swapped
+        glFlush();
+    }
+
+    if (m_nextLayer < bricks)
+    {
+        return false;
+    }
+    buildRange();
+    m_finished = true;
+    return true;
+}
+
+void GpuBaker::buildRange()
+{
+    int bricks = (m_settings.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    const ShaderReflection& range = GetShaderReflection(m_rangeProgram);
+    glUseProgram(m_rangeProgram);
+    glUniform1i(range.location("bricks"), bricks);
+    glUniform1i(range.location("resolution"), m_settings.resolution);
+    glBindImageTexture(0, m_texture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+
+    for (int level = 0; level < m_rangeLevels; ++level)
+    {
+        // Every level reads what the dispatch before it wrote
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        int size = 1 << (m_rangeLevels - 1 - level);
+        glUniform1i(range.location("level"), level);
+        glUniform1i(range.location("size"), size);
+        glBindImageTexture(1, m_rangeTexture, std::max(level - 1, 0), GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(2, m_rangeTexture, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+        int groups = (size + RANGE_GROUP_SIZE - 1) / RANGE_GROUP_SIZE;
+        glDispatchCompute(groups, groups, groups);
+    }
+
+    // The renderer samples both textures
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glFlush();
+}
+
+GLuint GpuBaker::takeTexture()
+{
+    if (!m_finished)
+    {
+        return 0;
+    }
+    GLuint texture = m_texture;
+    m_texture = 0;
+    return texture;
+}
+
+GLuint GpuBaker::takeRangeTexture()
+{
+    if (!m_finished)
+    {
+        return 0;
+    }
+    GLuint texture = m_rangeTexture;
+    m_rangeTexture = 0;
+    return texture;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "VoxelBaker.h"
+
+#include <GL/glew.h>
+
+#include <string>
+
+// Bakes a volume with the compute shader fractals_bake_cs.glsl straight into a new R32F 3D
+// texture, and builds its min/max range texture (MinMaxPyramid's layout) with fractals_range_cs.glsl,
+// so a rebake never touches host memory, the disk or the upload path. Every voxel is evaluated;
+// strategy, symmetry and intervals are ignored.
+// The volume is dispatched a few brick layers per pump(), so no single dispatch runs long enough
+// to trip the driver's watchdog. Only needs GL 4.3 compute shaders and image load/store, which
+// software implementations like Mesa's llvmpipe have too. Needs a current GL context for its
+// whole lifetime.
+class GpuBaker
+{
+public:
+    // Loads the compute shaders from shaderDir, check valid() before using the baker
+    explicit GpuBaker(const std::string& shaderDir);
+    ~GpuBaker();
+
+    GpuBaker(const GpuBaker&) = delete;
+    GpuBaker& operator=(const GpuBaker&) = delete;
+
+    // False if the compute shaders failed to compile, e.g. without GL 4.3
+    bool valid() const { return m_bakeProgram != 0 && m_rangeProgram != 0; }
+
+    // Starts baking settings into new textures whose lookups outside the volume return border.
+    // A bake still in progress is abandoned and its textures deleted.
+    void begin(const BakeSettings& settings, float border);
+    void cancel();
+
+    // Dispatches up to maxLayers more brick layers, and the range texture after the last one.
+    // Returns true once all of it has been submitted.
+    bool pump(int maxLayers);
+
+    bool busy() const { return m_texture != 0 && !m_finished; }
+    const BakeSettings& settings() const { return m_settings; }
+
+    // The finished textures (0 while a bake is in progress), the caller owns them from now on.
+    // The range texture has rangeLevels() mip levels.
+    GLuint takeTexture();
+    GLuint takeRangeTexture();
+    int rangeLevels() const { return m_rangeLevels; }
+
+private:
+    void deleteTextures();
+    void buildRange();
+
+    GLuint m_bakeProgram = 0;
+    GLuint m_rangeProgram = 0;
+
+    BakeSettings m_settings;
+    GLuint m_texture = 0;
+    GLuint m_rangeTexture = 0;
+    int m_rangeLevels = 0;
+    int m_nextLayer = 0;
+    bool m_finished = false;
+};
@@ -1,11 +1,53 @@
 #include <GL/glew.h>
 
+#include "InitShader.h"
+
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <cstring>
+#include <vector>
 using namespace std;
 
 //Adapted from Edward Angels InitShader code
 
+static string shaderDefines;
+static map<GLuint, ShaderReflection> reflections;
+
+void SetShaderDefines(const char* defines)
+{
+   shaderDefines = defines ? defines : "";
+}
+
+// Insert the #define lines from SetShaderDefines right after the #version directive
+static char* insertShaderDefines(char* source)
+{
+   if (shaderDefines.empty())
+   {
+      return source;
+   }
+
+   string text(source);
+   size_t insertAt = 0;
+   size_t version = text.find("#version");
+   if (version != string::npos)
+   {
+      size_t lineEnd = text.find('\n', version);
+      insertAt = (lineEnd == string::npos) ? text.size() : lineEnd + 1;
+   }
+   string defines = shaderDefines;
+   if (defines.back() != '\n')
+   {
+      defines += '\n';
+   }
+   text.insert(insertAt, defines);
+
+   char* bytes = new char[text.size() + 1];
+   memcpy(bytes, text.c_str(), text.size() + 1);
+   delete[] source;
+   return bytes;
+}
+
 // Create a NULL-terminated string by reading the provided file
 static char* readShaderSource(const char* shaderFile)
 {
@@ -18,11 +60,88 @@ static char* readShaderSource(const char* shaderFile)
       memset(bytes, 0, filesize + 1);
       ifs.read(bytes, filesize);
       ifs.close();
-      return bytes;
+      return insertShaderDefines(bytes);
    }
    return NULL;
 }
 
+GLint ShaderReflection::location(const string& name) const
+{
+   auto found = locations.find(name);
+   return found == locations.end() ? -1 : found->second;
+}
+
+const ShaderReflection::Block* ShaderReflection::block(const string& name) const
+{
+   auto found = blocks.find(name);
+   return found == blocks.end() ? NULL : &found->second;
+}
+
+const ShaderReflection& GetShaderReflection(GLuint program)
+{
+   static const ShaderReflection none;
+   auto found = reflections.find(program);
+   return found == reflections.end() ? none : found->second;
+}
+
+void DeleteShaderProgram(GLuint program)
+{
+   reflections.erase(program);
+   glDeleteProgram(program);
+}
+
+static string resourceName(GLuint program, GLenum interface, GLuint index, GLint length)
+{
+   vector<char> name(length + 1);
+   glGetProgramResourceName(program, interface, index, length + 1, NULL, name.data());
+   string text(name.data());
+   if (text.size() > 3 && text.compare(text.size() - 3, 3, "[0]") == 0)
+   {
+      text.resize(text.size() - 3);
+   }
+   return text;
+}
+
+// Records the locations and block layouts of a freshly linked program
+static void reflectProgram(GLuint program)
+{
+   ShaderReflection reflection;
+
+   GLint blockCount = 0;
+   glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &blockCount);
+   vector<string> blockNames(blockCount);
+   for (GLint i = 0; i < blockCount; ++i)
+   {
+      const GLenum props[3] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+      GLint values[3];
+      glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, i, 3, props, 3, NULL, values);
+      blockNames[i] = resourceName(program, GL_UNIFORM_BLOCK, i, values[0]);
+      ShaderReflection::Block& block = reflection.blocks[blockNames[i]];
+      block.binding = values[1];
+      block.size = values[2];
+   }
+
+   GLint uniformCount = 0;
+   glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+   for (GLint i = 0; i < uniformCount; ++i)
+   {
+      const GLenum props[4] = { GL_NAME_LENGTH, GL_BLOCK_INDEX, GL_LOCATION, GL_OFFSET };
+      GLint values[4];
+      glGetProgramResourceiv(program, GL_UNIFORM, i, 4, props, 4, NULL, values);
+      string name = resourceName(program, GL_UNIFORM, i, values[0]);
+      if (values[1] >= 0)
+      {
+         reflection.blocks[blockNames[values[1]]].offsets[name] = values[3];
+      }
+      else
+      {
+         reflection.locations[name] = values[2];
+      }
+   }
+
+   reflections[program] = reflection;
+}
+
 void printShaderCompileError(GLuint shader)
 {
    GLint  logSize;
@@ -105,6 +224,8 @@ GLuint InitShader(const char* computeShaderFile)
       return -1;
    }
 
+   reflectProgram(program);
+
    /* use program object */
    glUseProgram(program);
 
@@ -185,6 +306,8 @@ GLuint InitShader(const char* vShaderFile, const char* fShaderFile)
       return -1;
    }
 
+   reflectProgram(program);
+
    /* use program object */
    glUseProgram(program);
    return program;
@@ -263,6 +386,8 @@ GLuint InitShader(const char* vShaderFile, const char* gShaderFile, const char*
       return -1;
    }
 
+   reflectProgram(program);
+
    /* use program object */
    glUseProgram(program);
 
@@ -4,9 +4,41 @@
 #include <windows.h>
 #include <GL/GL.h>
 
+#include <map>
+#include <string>
+
 GLuint InitShader( const char* computeShaderFile);
 GLuint InitShader( const char* vertexShaderFile, const char* fragmentShaderFile );
 GLuint InitShader( const char* vertexShaderFile, const char* geometryShader, const char* fragmentShaderFile );
 
+// #define lines inserted after the #version directive of every shader loaded from now on, "" for none
+void SetShaderDefines( const char* defines );
+
+// Active uniforms and uniform blocks of a program, queried once when InitShader links it so
+// nothing has to ask the driver for a location per frame
+struct ShaderReflection
+{
+   struct Block
+   {
+      GLint binding = -1;
+      GLint size = 0;                        // bytes of buffer the block reads
+      std::map<std::string, GLint> offsets;  // byte offset of every member
+   };
+
+   std::map<std::string, GLint> locations;   // uniforms outside blocks, arrays by their name without [0]
+   std::map<std::string, Block> blocks;
+
+   // -1 for uniforms the program doesn't use, like glGetUniformLocation
+   GLint location( const std::string& name ) const;
+   const Block* block( const std::string& name ) const;
+};
+
+// Reflection of a program InitShader returned, empty for any other
+const ShaderReflection& GetShaderReflection( GLuint program );
+
+// Deletes a program InitShader returned along with its reflection, so a later program given
+// the same name doesn't find stale entries
+void DeleteShaderProgram( GLuint program );
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "JobSystem.h"
+
+static thread_local int worker_index = -1;
+
+JobSystem::JobSystem(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = (int)std::thread::hardware_concurrency();
+    }
+    if (threadCount <= 0)
+    {
+        threadCount = 1;
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_threads.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& t : m_threads)
+    {
+        t.join();
+    }
+}
+
+int JobSystem::currentWorker()
+{
+    return worker_index;
+}
+
+void JobSystem::run(std::vector<std::vector<Job>>& groups)
+{
+    int total = 0;
+    for (const std::vector<Job>& group : groups)
+    {
+        total += (int)group.size();
+    }
+    if (total == 0)
+    {
+        groups.clear();
+        return;
+    }
+
+    // Count the jobs before queueing them so a worker that is still awake can't
+    // take the counter below zero
+    m_pending += total;
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        Worker& w = *m_workers[g % m_workers.size()];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        for (Job& job : groups[g])
+        {
+            w.queue.push_back(std::move(job));
+        }
+    }
+    groups.clear();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_wake.notify_all();
+    m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool JobSystem::popJob(int index, Job& job)
+{
+    // Own queue first, front to back
+    {
+        Worker& own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty())
+        {
+            job = std::move(own.queue.front());
+            own.queue.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back of the other queues, starting with the next worker
+    int count = (int)m_workers.size();
+    for (int i = 1; i < count; ++i)
+    {
+        Worker& victim = *m_workers[(index + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty())
+        {
+            job = std::move(victim.queue.back());
+            victim.queue.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::workerLoop(int index)
+{
+    worker_index = index;
+    unsigned int seen = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+            if (m_quit)
+            {
+                return;
+            }
+            seen = m_generation;
+        }
+
+        Job job;
+        while (popJob(index, job))
+        {
+            job();
+            job = nullptr;
+            if (--m_pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with one job queue per worker.
+// A worker drains its own queue from the front and, once it is empty, steals from the
+// back of the other queues, so uneven jobs (interior vs. exterior bricks) don't leave cores idle.
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+
+    // threadCount <= 0 uses every hardware thread
+    explicit JobSystem(int threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    int threadCount() const { return (int)m_workers.size(); }
+
+    // Runs every group of jobs and blocks until all of them have finished.
+    // Each group starts out on a single worker (group i goes to worker i % threadCount).
+    void run(std::vector<std::vector<Job>>& groups);
+
+    // Index of the pool worker running the calling thread, or -1 outside the pool
+    static int currentWorker();
+
+private:
+    struct Worker
+    {
+        std::deque<Job> queue;
+        std::mutex mutex;
+    };
+
+    void workerLoop(int index);
+    bool popJob(int index, Job& job);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::atomic<int> m_pending{ 0 };
+    unsigned int m_generation = 0;
+    bool m_quit = false;
+};
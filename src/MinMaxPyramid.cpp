@@ -0,0 +1,162 @@
+#include "MinMaxPyramid.h"
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// Trilinear lookups anywhere inside a brick also read the voxel just past each face, so every
+// level 0 cell covers its brick plus a one voxel apron. Aprons that leave the volume read the zero border.
+static glm::vec2 brick_range(const BrickMap& volume, int bx, int by, int bz)
+{
+    glm::ivec3 lo = glm::ivec3(bx, by, bz) * BRICK_SIZE - 1;
+    glm::ivec3 hi = glm::ivec3(bx + 1, by + 1, bz + 1) * BRICK_SIZE + 1;
+    glm::vec2 range = volume.valueRange(lo, hi);
+    if (glm::any(glm::lessThan(lo, glm::ivec3(0))) || glm::any(glm::greaterThan(hi, glm::ivec3(volume.resolution()))))
+    {
+        range = glm::vec2(std::min(range.x, 0.f), std::max(range.y, 0.f));
+    }
+    return range;
+}
+
+MinMaxPyramid::MinMaxPyramid(const BrickMap& volume, int threadCount)
+{
+    JobSystem jobs(threadCount);
+    build(volume, jobs);
+}
+
+MinMaxPyramid::MinMaxPyramid(const BrickMap& volume, JobSystem& jobs)
+{
+    build(volume, jobs);
+}
+
+void MinMaxPyramid::build(const BrickMap& volume, JobSystem& jobs)
+{
+    int bricks = volume.bricksPerSide();
+    m_baseSize = 1;
+    while (m_baseSize < bricks)
+    {
+        m_baseSize *= 2;
+    }
+
+    size_t n = (size_t)m_baseSize;
+    std::vector<glm::vec2> base(n * n * n, glm::vec2(0.f));
+
+    std::vector<std::vector<JobSystem::Job>> slabs(bricks);
+    for (int bz = 0; bz < bricks; ++bz)
+    {
+        for (int by = 0; by < bricks; ++by)
+        {
+            slabs[bz].push_back([&volume, &base, n, bricks, by, bz]
+            {
+                for (int bx = 0; bx < bricks; ++bx)
+                {
+                    base[(size_t)bx + n * ((size_t)by + n * (size_t)bz)] = brick_range(volume, bx, by, bz);
+                }
+            });
+        }
+    }
+    jobs.run(slabs);
+    m_levels.push_back(std::move(base));
+    buildLevels();
+}
+
+// Union of the eight children of cell (x, y, z) of a level size cells across, fine being the level below it
+static glm::vec2 children_range(const std::vector<glm::vec2>& fine, size_t size, size_t x, size_t y, size_t z)
+{
+    glm::vec2 range(fine[2 * x + 2 * size * (2 * y + 2 * size * 2 * z)]);
+    for (int child = 1; child < 8; ++child)
+    {
+        size_t cx = 2 * x + (child & 1), cy = 2 * y + ((child >> 1) & 1), cz = 2 * z + ((child >> 2) & 1);
+        glm::vec2 c = fine[cx + 2 * size * (cy + 2 * size * cz)];
+        range = glm::vec2(std::min(range.x, c.x), std::max(range.y, c.y));
+    }
+    return range;
+}
+
+void MinMaxPyramid::update(const BrickMap& volume, const std::vector<size_t>& bricks, std::vector<std::vector<size_t>>* changedCells)
+{
+    if (changedCells)
+    {
+        changedCells->assign(m_levels.size(), std::vector<size_t>());
+    }
+    if (bricks.empty())
+    {
+        return;
+    }
+
+    // A changed brick also lies in the apron of every neighbouring cell
+    int side = volume.bricksPerSide();
+    size_t n = (size_t)m_baseSize;
+    std::vector<glm::vec2>& base = m_levels[0];
+    std::vector<uint8_t> dirty(n * n * n, 0);
+    std::vector<size_t> cells;
+    for (size_t brick : bricks)
+    {
+        glm::ivec3 b = volume.brickCoord(brick);
+        glm::ivec3 lo = glm::max(b - 1, glm::ivec3(0)), hi = glm::min(b + 1, glm::ivec3(side - 1));
+        for (int z = lo.z; z <= hi.z; ++z)
+        {
+            for (int y = lo.y; y <= hi.y; ++y)
+            {
+                for (int x = lo.x; x <= hi.x; ++x)
+                {
+                    size_t cell = (size_t)x + n * ((size_t)y + n * (size_t)z);
+                    if (!dirty[cell])
+                    {
+                        dirty[cell] = 1;
+                        base[cell] = brick_range(volume, x, y, z);
+                        cells.push_back(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(cells.begin(), cells.end());
+    if (changedCells)
+    {
+        (*changedCells)[0] = cells;
+    }
+
+    // Only the cells above a recomputed one can change
+    for (size_t level = 1; level < m_levels.size(); ++level)
+    {
+        size_t fine_size = (size_t)levelSize((int)level - 1), size = (size_t)levelSize((int)level);
+        for (size_t& cell : cells)
+        {
+            size_t x = cell % fine_size, y = (cell / fine_size) % fine_size, z = cell / (fine_size * fine_size);
+            cell = x / 2 + size * (y / 2 + size * (z / 2));
+        }
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+        for (size_t cell : cells)
+        {
+            m_levels[level][cell] = children_range(m_levels[level - 1], size, cell % size, (cell / size) % size, cell / (size * size));
+        }
+        if (changedCells)
+        {
+            (*changedCells)[level] = cells;
+        }
+    }
+}
+
+void MinMaxPyramid::buildLevels()
+{
+    // Every coarser cell is the union of its eight children
+    for (size_t size = (size_t)m_baseSize / 2; size >= 1; size /= 2)
+    {
+        const std::vector<glm::vec2>& fine = m_levels.back();
+        std::vector<glm::vec2> coarse(size * size * size);
+        for (size_t z = 0; z < size; ++z)
+        {
+            for (size_t y = 0; y < size; ++y)
+            {
+                for (size_t x = 0; x < size; ++x)
+                {
+                    coarse[x + size * (y + size * z)] = children_range(fine, size, x, y, z);
+                }
+            }
+        }
+        m_levels.push_back(std::move(coarse));
+    }
+}
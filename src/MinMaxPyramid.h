@@ -0,0 +1,49 @@
+#pragma once
+
+#include "BrickMap.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class JobSystem;
+
+// Min/max density pyramid over a BrickMap for empty-space skipping in the ray marcher.
+// Level 0 has one cell per brick, every level above halves the cells per side down to a single cell.
+// Level 0 is padded to a power of two so the levels line up with the mip chain of a 3D texture;
+// padding cells read (0, 0) like the density texture's border.
+class MinMaxPyramid
+{
+public:
+    MinMaxPyramid() = default;
+
+    // threadCount <= 0 uses every hardware thread
+    explicit MinMaxPyramid(const BrickMap& volume, int threadCount = 0);
+
+    // Builds on jobs, for callers that already keep a pool around
+    MinMaxPyramid(const BrickMap& volume, JobSystem& jobs);
+
+    // Recomputes the cells that cover bricks of volume, the volume the pyramid was built from
+    // after only those bricks changed, and the cells above them. changedCells, if given, receives
+    // the recomputed cells of every level in increasing order.
+    void update(const BrickMap& volume, const std::vector<size_t>& bricks, std::vector<std::vector<size_t>>* changedCells = nullptr);
+
+    int levelCount() const                  { return (int)m_levels.size(); }
+    int levelSize(int level) const          { return m_baseSize >> level; }
+
+    // Cells of one level, x fastest, min in x and max in y
+    const glm::vec2* levelData(int level) const { return m_levels[level].data(); }
+
+    glm::vec2 range(int level, int x, int y, int z) const
+    {
+        size_t n = (size_t)levelSize(level);
+        return m_levels[level][(size_t)x + n * ((size_t)y + n * (size_t)z)];
+    }
+
+private:
+    void build(const BrickMap& volume, JobSystem& jobs);
+    void buildLevels();
+
+    int m_baseSize = 0;
+    std::vector<std::vector<glm::vec2>> m_levels;
+};
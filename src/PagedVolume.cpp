@@ -0,0 +1,375 @@
+#include "PagedVolume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+PagedVolume::~PagedVolume()
+{
+    close();
+}
+
+bool PagedVolume::open(const std::string& path, size_t cacheBytes, int prefetchDepth)
+{
+    close();
+    if (!m_file.open(path))
+    {
+        return false;
+    }
+    if (!ReadVolumeHeader(m_file.data(), m_file.size(), m_header) || !ReadVolumeIndex(m_file.data(), m_header, m_bricks))
+    {
+        // The payload checksum is skipped, it would mean reading the whole file up front
+        std::cerr << path << " is not a version " << CODEC_VERSION << " compressed volume or is damaged" << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    m_bricksPerSide = (m_header.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    m_capacity = std::max<size_t>(cacheBytes / sizeof(Page), 1);
+    m_stats = Stats();
+    m_prefetchDepth = std::max(prefetchDepth, 0);
+    m_lastMiss = 0;
+    m_stopPrefetch = false;
+    if (m_prefetchDepth > 0)
+    {
+        m_prefetchThread = std::thread(&PagedVolume::prefetchLoop, this);
+    }
+    return true;
+}
+
+void PagedVolume::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopPrefetch = true;
+        m_prefetchQueue.clear();
+    }
+    m_prefetchReady.notify_all();
+    if (m_prefetchThread.joinable())
+    {
+        m_prefetchThread.join();
+    }
+
+    m_pages.clear();
+    m_lru.clear();
+    m_bricks.clear();
+    m_file.close();
+    m_header = VolumeHeader();
+    m_bricksPerSide = 0;
+}
+
+std::shared_ptr<PagedVolume::Page> PagedVolume::decode(size_t brick)
+{
+    auto page = std::make_shared<Page>();
+    if (!DecodeBrick(m_file.data(), m_bricks[brick], page->voxels))
+    {
+        std::fill(page->voxels, page->voxels + BRICK_VOXELS, 0.f);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.damaged++;
+    }
+    return page;
+}
+
+std::shared_ptr<PagedVolume::Page> PagedVolume::lookupLocked(size_t brick)
+{
+    auto it = m_pages.find(brick);
+    if (it == m_pages.end())
+    {
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return it->second.page;
+}
+
+void PagedVolume::insertLocked(size_t brick, std::shared_ptr<Page> page)
+{
+    if (m_pages.count(brick))
+    {
+        return;
+    }
+    m_lru.push_front(brick);
+    m_pages[brick] = CachedPage{ std::move(page), m_lru.begin() };
+    while (m_pages.size() > m_capacity)
+    {
+        m_pages.erase(m_lru.back());
+        m_lru.pop_back();
+        m_stats.evicted++;
+    }
+}
+
+// Queues the bricks that continue the stride from the previous miss to this one
+void PagedVolume::predictLocked(size_t brick)
+{
+    if (m_prefetchDepth == 0)
+    {
+        return;
+    }
+    long long stride = (long long)brick - (long long)m_lastMiss;
+    m_lastMiss = brick;
+    m_prefetchQueue.clear();
+    if (stride == 0)
+    {
+        return;
+    }
+
+    long long next = (long long)brick;
+    for (int queued = 0; queued < m_prefetchDepth;)
+    {
+        next += stride;
+        if (next < 0 || next >= (long long)m_bricks.size())
+        {
+            break;
+        }
+        // Constant bricks are free, look past them for the next dense one
+        if (m_bricks[(size_t)next].isConstant())
+        {
+            continue;
+        }
+        if (!m_pages.count((size_t)next))
+        {
+            m_prefetchQueue.push_back((size_t)next);
+        }
+        ++queued;
+    }
+    m_prefetchReady.notify_one();
+}
+
+void PagedVolume::prefetchLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_prefetchReady.wait(lock, [this] { return m_stopPrefetch || !m_prefetchQueue.empty(); });
+        if (m_stopPrefetch)
+        {
+            return;
+        }
+        size_t brick = m_prefetchQueue.front();
+        m_prefetchQueue.pop_front();
+        if (m_pages.count(brick))
+        {
+            continue;
+        }
+
+        lock.unlock();
+        std::shared_ptr<Page> page = decode(brick);
+        lock.lock();
+        if (!m_pages.count(brick))
+        {
+            insertLocked(brick, std::move(page));
+            m_stats.prefetched++;
+        }
+    }
+}
+
+std::shared_ptr<const float> PagedVolume::brickData(size_t brick)
+{
+    if (m_bricks[brick].isConstant())
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<Page> page;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        page = lookupLocked(brick);
+        if (page)
+        {
+            m_stats.hits++;
+        }
+        else
+        {
+            m_stats.misses++;
+            predictLocked(brick);
+        }
+    }
+
+    if (!page)
+    {
+        // Decoded outside the lock, so other threads keep hitting the cache meanwhile.
+        // If two threads miss the same brick the second decode is simply dropped.
+        page = decode(brick);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        insertLocked(brick, page);
+    }
+    return std::shared_ptr<const float>(page, page->voxels);
+}
+
+void PagedVolume::readBrick(size_t brick, float* voxels)
+{
+    std::shared_ptr<const float> data = brickData(brick);
+    if (data)
+    {
+        memcpy(voxels, data.get(), BRICK_VOXELS * sizeof(float));
+    }
+    else
+    {
+        std::fill(voxels, voxels + BRICK_VOXELS, m_bricks[brick].value);
+    }
+}
+
+float PagedVolume::voxel(int x, int y, int z)
+{
+    size_t brick = brickIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+    std::shared_ptr<const float> data = brickData(brick);
+    if (!data)
+    {
+        return m_bricks[brick].value;
+    }
+    int lx = x % BRICK_SIZE, ly = y % BRICK_SIZE, lz = z % BRICK_SIZE;
+    return data.get()[lx + BRICK_SIZE * (ly + BRICK_SIZE * lz)];
+}
+
+void PagedVolume::readSlab(int z0, int depth, float* out)
+{
+    size_t n = (size_t)m_header.resolution;
+    int z1 = z0 + depth;
+    for (int bz = z0 / BRICK_SIZE; bz * BRICK_SIZE < z1; ++bz)
+    {
+        int za = std::max(z0, bz * BRICK_SIZE), zb = std::min(z1, (bz + 1) * BRICK_SIZE);
+        for (int by = 0; by < m_bricksPerSide; ++by)
+        {
+            int ya = by * BRICK_SIZE, yb = std::min(m_header.resolution, ya + BRICK_SIZE);
+            for (int bx = 0; bx < m_bricksPerSide; ++bx)
+            {
+                size_t brick = brickIndex(bx, by, bz);
+                int x0 = bx * BRICK_SIZE;
+                int width = std::min(BRICK_SIZE, m_header.resolution - x0);
+                std::shared_ptr<const float> data = brickData(brick);
+                for (int z = za; z < zb; ++z)
+                {
+                    for (int y = ya; y < yb; ++y)
+                    {
+                        float* row = out + n * ((size_t)y + n * (size_t)(z - z0)) + x0;
+                        if (data)
+                        {
+                            memcpy(row, data.get() + BRICK_SIZE * ((y - ya) + BRICK_SIZE * (z % BRICK_SIZE)), width * sizeof(float));
+                        }
+                        else
+                        {
+                            std::fill(row, row + width, m_bricks[brick].value);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+PagedVolume::Stats PagedVolume::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+bool BakeVolumeToFile(const BakeSettings& settings, const std::string& path, int layersPerPass, float maxError, BakeStats* stats)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Holds every brick's index entry but only the dense bricks of the pass being baked
+    BrickMap volume(settings.resolution);
+    VolumeWriter writer;
+    if (!writer.open(path, settings, maxError, settings.threads))
+    {
+        return false;
+    }
+
+    int layers = volume.bricksPerSide();
+    size_t per_layer = (size_t)layers * layers;
+    for (int first = 0; first < layers; first += std::max(layersPerPass, 1))
+    {
+        int end = std::min(layers, first + std::max(layersPerPass, 1));
+        BakeBrickLayers(settings, volume, first, end);
+        if (settings.cancel && *settings.cancel)
+        {
+            return false;
+        }
+
+        if (!writer.append(volume, first * per_layer, end * per_layer))
+        {
+            return false;
+        }
+        for (size_t brick = first * per_layer; brick < end * per_layer; ++brick)
+        {
+            volume.setConstant(brick, 0.f);
+        }
+    }
+    if (!writer.finish())
+    {
+        return false;
+    }
+
+    if (stats)
+    {
+        double n = settings.resolution;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        stats->seconds = elapsed.count();
+        stats->voxels_per_second = n * n * n / std::max(stats->seconds, 1e-9);
+        stats->seeded_bricks = 0;
+    }
+    return true;
+}
+
+BakeVerification VerifyVolumeFile(const BakeSettings& settings, const std::string& path, int layersPerPass, float maxError,
+                                  size_t cacheBytes, PagedVolume::Stats* pageStats)
+{
+    BakeVerification result;
+    PagedVolume file;
+    if (!file.open(path, cacheBytes))
+    {
+        return result;
+    }
+
+    BakeSettings reference_settings = settings;
+    reference_settings.strategy = BAKE_EVERY_VOXEL;
+    reference_settings.symmetry = false;
+    reference_settings.intervals = false;
+
+    BrickMap reference(settings.resolution);
+    int n = settings.resolution;
+    int layers = reference.bricksPerSide();
+    size_t per_layer = (size_t)layers * layers;
+    std::vector<float> voxels(BRICK_VOXELS);
+    for (int first = 0; first < layers; first += std::max(layersPerPass, 1))
+    {
+        int end = std::min(layers, first + std::max(layersPerPass, 1));
+        BakeStats stats;
+        BakeBrickLayers(reference_settings, reference, first, end, &stats);
+        result.reference_seconds += stats.seconds;
+
+        for (size_t brick = first * per_layer; brick < end * per_layer; ++brick)
+        {
+            file.readBrick(brick, voxels.data());
+            glm::ivec3 origin = reference.brickCoord(brick) * BRICK_SIZE;
+            bool mismatched = false;
+            for (int z = origin.z; z < std::min(origin.z + BRICK_SIZE, n); ++z)
+            {
+                for (int y = origin.y; y < std::min(origin.y + BRICK_SIZE, n); ++y)
+                {
+                    for (int x = origin.x; x < std::min(origin.x + BRICK_SIZE, n); ++x)
+                    {
+                        float value = voxels[(x - origin.x) + BRICK_SIZE * ((y - origin.y) + BRICK_SIZE * (z - origin.z))];
+                        float error = std::abs(value - reference.voxel(x, y, z));
+                        result.voxels++;
+                        result.max_error = std::max(result.max_error, error);
+                        if (error > maxError)
+                        {
+                            result.mismatched_voxels++;
+                            mismatched = true;
+                        }
+                    }
+                }
+            }
+            result.mismatched_bricks += mismatched;
+            reference.setConstant(brick, 0.f);
+        }
+    }
+
+    if (pageStats)
+    {
+        *pageStats = file.stats();
+    }
+    return result;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "VolumeCodec.h"
+#include "MappedFile.h"
+#include "VoxelBaker.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Read access to a compressed volume file (VolumeCodec.h) that is too large to decode into memory.
+// The file is memory mapped and its dense bricks are decoded on demand into a fixed budget of
+// pages, evicted least recently used first. Constant bricks never take a page.
+// Every miss also predicts the next ones from the stride between the last two misses, and a
+// background thread decodes those ahead of time, so a consumer walking the volume in any fixed
+// brick order mostly finds its bricks already decoded.
+// All reads are safe from several threads.
+class PagedVolume
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t prefetched = 0;      // pages decoded by the prefetch thread
+        size_t evicted = 0;
+        size_t damaged = 0;         // bricks that failed to decode and read as 0
+    };
+
+    PagedVolume() = default;
+    ~PagedVolume();
+
+    PagedVolume(const PagedVolume&) = delete;
+    PagedVolume& operator=(const PagedVolume&) = delete;
+
+    // Maps path and reads its header and index; the payload is only read as bricks are used.
+    // cacheBytes bounds the decoded pages, prefetchDepth is how many bricks ahead are predicted (0 = none).
+    bool open(const std::string& path, size_t cacheBytes, int prefetchDepth = 8);
+    void close();
+
+    const VolumeHeader& header() const  { return m_header; }
+    int resolution() const              { return m_header.resolution; }
+    int bricksPerSide() const           { return m_bricksPerSide; }
+    size_t brickCount() const           { return m_bricks.size(); }
+
+    size_t brickIndex(int bx, int by, int bz) const
+    {
+        return (size_t)bx + (size_t)m_bricksPerSide * ((size_t)by + (size_t)m_bricksPerSide * (size_t)bz);
+    }
+
+    bool isConstant(size_t brick) const         { return m_bricks[brick].isConstant(); }
+    float constantValue(size_t brick) const     { return m_bricks[brick].value; }
+
+    // Voxels of a dense brick, nullptr for constant ones. The page stays valid for as long as the
+    // pointer is held, even if the cache evicts it in the meantime.
+    std::shared_ptr<const float> brickData(size_t brick);
+
+    void readBrick(size_t brick, float* voxels);
+    float voxel(int x, int y, int z);
+
+    // Expands layers [z0, z0 + depth) to dense x-fastest rows like BrickMap::readSlab(),
+    // fetching every brick once
+    void readSlab(int z0, int depth, float* out);
+
+    Stats stats() const;
+
+private:
+    struct Page
+    {
+        float voxels[BRICK_VOXELS];
+    };
+    struct CachedPage
+    {
+        std::shared_ptr<Page> page;
+        std::list<size_t>::iterator lru;
+    };
+
+    std::shared_ptr<Page> decode(size_t brick);
+    std::shared_ptr<Page> lookupLocked(size_t brick);
+    void insertLocked(size_t brick, std::shared_ptr<Page> page);
+    void predictLocked(size_t brick);
+    void prefetchLoop();
+
+    MappedFile m_file;
+    VolumeHeader m_header;
+    std::vector<CodedBrick> m_bricks;
+    int m_bricksPerSide = 0;
+
+    mutable std::mutex m_mutex;
+    size_t m_capacity = 0;                      // in pages
+    std::list<size_t> m_lru;                    // most recently used brick first
+    std::unordered_map<size_t, CachedPage> m_pages;
+    Stats m_stats;
+
+    int m_prefetchDepth = 0;
+    size_t m_lastMiss = 0;
+    std::deque<size_t> m_prefetchQueue;
+    std::condition_variable m_prefetchReady;
+    bool m_stopPrefetch = false;
+    std::thread m_prefetchThread;
+};
+
+// Bakes settings.resolution^3 straight into a compressed volume file, layersPerPass brick layers
+// at a time, so only the brick index and one pass worth of dense bricks are ever in memory.
+// Honours settings.cancel, in which case nothing is written.
+bool BakeVolumeToFile(const BakeSettings& settings, const std::string& path, int layersPerPass = 4,
+                      float maxError = CODEC_DEFAULT_MAX_ERROR, BakeStats* stats = nullptr);
+
+// VerifyBake() for a volume file written by BakeVolumeToFile(): bakes settings again evaluating every voxel,
+// layersPerPass brick layers at a time, and compares the file read through a PagedVolume of cacheBytes
+// against it. Differences within maxError, the error the file was encoded with, don't count.
+BakeVerification VerifyVolumeFile(const BakeSettings& settings, const std::string& path, int layersPerPass, float maxError,
+                                  size_t cacheBytes, PagedVolume::Stats* pageStats = nullptr);
@@ -0,0 +1,94 @@
+#include "ProgressiveBake.h"
+
+#include <algorithm>
+#include <iostream>
+
+ProgressiveBake::ProgressiveBake(const BakeSettings& settings, int firstResolution, VolumeCache* cache)
+    : m_settings(settings), m_firstResolution(std::min(firstResolution, settings.resolution)), m_cache(cache)
+{
+    m_settings.cancel = &m_cancel;
+    m_jobs = std::make_unique<JobSystem>(settings.threads);
+    m_settings.jobs = m_jobs.get();
+    m_thread = std::thread(&ProgressiveBake::run, this);
+}
+
+ProgressiveBake::~ProgressiveBake()
+{
+    m_cancel = true;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+std::shared_ptr<const BrickMap> ProgressiveBake::poll(BakeStats* stats, std::shared_ptr<MinMaxPyramid>* pyramid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (stats)
+    {
+        *stats = m_readyStats;
+    }
+    if (pyramid)
+    {
+        *pyramid = std::move(m_readyPyramid);
+    }
+    m_readyPyramid.reset();
+    return std::move(m_ready);
+}
+
+void ProgressiveBake::publish(std::shared_ptr<const BrickMap> level, const BakeStats& stats)
+{
+    // Built here rather than on the render thread, which would stall for it on large levels
+    auto pyramid = std::make_shared<MinMaxPyramid>(*level, *m_jobs);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ready = std::move(level);
+    m_readyPyramid = std::move(pyramid);
+    m_readyStats = stats;
+}
+
+void ProgressiveBake::run()
+{
+    // A cached volume, in memory or on disk, makes every level redundant
+    if (m_cache)
+    {
+        m_current = m_settings.resolution;
+        std::shared_ptr<const BrickMap> cached = m_cache->find(m_settings);
+        if (cached)
+        {
+            publish(cached, BakeStats());
+            m_current = 0;
+            m_finished = true;
+            return;
+        }
+    }
+
+    std::shared_ptr<const BrickMap> seed;
+    for (int resolution = m_firstResolution; !m_cancel; resolution = std::min(resolution * 2, m_settings.resolution))
+    {
+        m_current = resolution;
+
+        BakeSettings settings = m_settings;
+        settings.resolution = resolution;
+        auto level = std::make_shared<BrickMap>();
+        BakeStats stats;
+        BakeVolume(settings, *level, &stats, seed.get());
+        if (m_cancel)
+        {
+            break;
+        }
+        publish(level, stats);
+
+        if (resolution == m_settings.resolution)
+        {
+            if (m_cache)
+            {
+                m_cache->store(m_settings, level);
+            }
+            break;
+        }
+        seed = level;
+    }
+    m_current = 0;
+    m_finished = true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "BrickMap.h"
+#include "JobSystem.h"
+#include "MinMaxPyramid.h"
+#include "VolumeCache.h"
+#include "VoxelBaker.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Bakes a volume on a background thread from coarse to fine: firstResolution^3 first, then twice
+// that per level up to settings.resolution, every level seeded from the one before it. Each level
+// is handed to the render thread as soon as it is done, so there is something on screen long
+// before the full resolution bake finishes. Every level comes with its MinMaxPyramid, built on the
+// bake thread too, and all of it runs on one JobSystem kept for the whole bake.
+class ProgressiveBake
+{
+public:
+    // If cache already holds a volume of these settings it is the only level published;
+    // otherwise the final level is stored in the cache once it is baked.
+    // The cache has to outlive the bake.
+    ProgressiveBake(const BakeSettings& settings, int firstResolution = 64, VolumeCache* cache = nullptr);
+
+    // Cancels the bake and waits for the background thread
+    ~ProgressiveBake();
+
+    ProgressiveBake(const ProgressiveBake&) = delete;
+    ProgressiveBake& operator=(const ProgressiveBake&) = delete;
+
+    // Newest level finished since the last call, or nullptr. Levels that finish between two calls
+    // are dropped in favour of the newest one. pyramid receives the level's range pyramid.
+    std::shared_ptr<const BrickMap> poll(BakeStats* stats = nullptr, std::shared_ptr<MinMaxPyramid>* pyramid = nullptr);
+
+    // True once the background thread has published its last level or given up
+    bool finished() const { return m_finished; }
+
+    // Resolution of the level being baked, 0 once finished
+    int currentResolution() const { return m_current; }
+
+private:
+    void run();
+    void publish(std::shared_ptr<const BrickMap> level, const BakeStats& stats);
+
+    BakeSettings m_settings;
+    int m_firstResolution;
+    VolumeCache* m_cache;
+    std::unique_ptr<JobSystem> m_jobs;
+
+    std::mutex m_mutex;
+    std::shared_ptr<const BrickMap> m_ready;
+    std::shared_ptr<MinMaxPyramid> m_readyPyramid;
+    BakeStats m_readyStats;
+
+    std::atomic<bool> m_cancel{ false };
+    std::atomic<bool> m_finished{ false };
+    std::atomic<int> m_current{ 0 };
+    std::thread m_thread;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Byte-level helpers shared by the volume codec, the sequence format and the cache keys.
+// Values are stored in the host's byte order.
+
+// Start value of an FNV-1a hash
+const uint64_t FNV1A_BASIS = 14695981039346656037ull;
+
+// FNV-1a of size bytes, continuing from hash so data in several pieces hashes like one
+inline uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = FNV1A_BASIS)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Appends the bytes of value
+template<class T>
+inline void PutValue(std::vector<uint8_t>& out, T value)
+{
+    size_t at = out.size();
+    out.resize(at + sizeof(T));
+    memcpy(out.data() + at, &value, sizeof(T));
+}
+
+// Reads a value and advances in past it, false if fewer than sizeof(T) bytes are left
+template<class T>
+inline bool GetValue(const uint8_t*& in, const uint8_t* end, T& value)
+{
+    if ((size_t)(end - in) < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return true;
+}
+
+// Seven bits per byte, low bits first, the top bit set on every byte but the last
+inline void PutVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+// False if the data ends before the varint does or it runs past 32 bits
+inline bool GetVarint(const uint8_t*& in, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Closed-form integer powers of triplex numbers, the Mandelbulb's z -> z^n.
+//
+// The polar form  r^n * (sin(n theta) cos(n phi), sin(n theta) sin(n phi), cos(n theta))
+// is expanded with de Moivre on two complex numbers:
+//   (z + i rho)^n        = r^n (cos(n theta) + i sin(n theta))      with rho = |(x, y)|
+//   ((x + i y) / rho)^n  = cos(n phi) + i sin(n phi)
+// which only needs multiplies, two square roots and a divide.
+//
+// T is float or one of the SIMD vector types from FractalSimdKernels.h. It needs + - *, /,
+// vsqrt(), a comparison with T(0) and select(mask, a, b), found by argument-dependent lookup
+// for the vector types and in namespace triplex for float.
+// Non-template helpers are static so SIMD translation units never share them with scalar code.
+
+#include <cmath>
+
+namespace triplex
+{
+    static inline float vsqrt(float x) { return sqrtf(x); }
+    static inline float select(bool m, float a, float b) { return m ? a : b; }
+}
+
+// (re + i im)^N, unrolled at compile time by squaring
+template<int N, class T>
+inline void ComplexPower(T re, T im, T& out_re, T& out_im)
+{
+    if constexpr (N == 1)
+    {
+        out_re = re;
+        out_im = im;
+    }
+    else if constexpr (N % 2 == 0)
+    {
+        T half_re, half_im;
+        ComplexPower<N / 2>(re, im, half_re, half_im);
+        out_re = half_re * half_re - half_im * half_im;
+        out_im = T(2.0f) * half_re * half_im;
+    }
+    else
+    {
+        T rest_re, rest_im;
+        ComplexPower<N - 1>(re, im, rest_re, rest_im);
+        out_re = rest_re * re - rest_im * im;
+        out_im = rest_re * im + rest_im * re;
+    }
+}
+
+// x^N by squaring
+template<int N, class T>
+inline T IntegerPower(T x)
+{
+    if constexpr (N == 0)
+        return T(1.0f);
+    else if constexpr (N == 1)
+        return x;
+    else if constexpr (N % 2 == 0)
+    {
+        T half = IntegerPower<N / 2>(x);
+        return half * half;
+    }
+    else
+        return IntegerPower<N - 1>(x) * x;
+}
+
+// Replaces (x, y, z) with (x, y, z)^N
+template<int N, class T>
+inline void TriplexPower(T& x, T& y, T& z)
+{
+    using triplex::vsqrt;
+    using triplex::select;
+
+    T rho = vsqrt(x * x + y * y);
+    auto off_axis = rho > T(0.0f);
+
+    // On the z axis atan2(0, 0) = 0, so cos(n phi) = 1 and sin(n phi) = 0
+    T inv_rho = T(1.0f) / select(off_axis, rho, T(1.0f));
+    T cos_phi = select(off_axis, x * inv_rho, T(1.0f));
+    T sin_phi = select(off_axis, y * inv_rho, T(0.0f));
+
+    T cos_n_phi, sin_n_phi, cos_n_theta, sin_n_theta;
+    ComplexPower<N>(cos_phi, sin_phi, cos_n_phi, sin_n_phi);
+    ComplexPower<N>(z, rho, cos_n_theta, sin_n_theta); // both scaled by r^N
+
+    x = sin_n_theta * cos_n_phi;
+    y = sin_n_theta * sin_n_phi;
+    z = cos_n_theta;
+}
+
+// Highest order with a specialized kernel
+const int MAX_INTEGER_ORDER = 16;
+
+// Integer order in [2, MAX_INTEGER_ORDER] that order is exactly equal to, or 0 if it's fractional
+static inline int IntegerOrder(float order)
+{
+    int n = (int)order;
+    return (float(n) == order && n >= 2 && n <= MAX_INTEGER_ORDER) ? n : 0;
+}
@@ -0,0 +1,173 @@
+#include "VolumeCache.h"
+
+#include "Serialization.h"
+#include "VolumeCodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+template<class T>
+static uint64_t hash_value(uint64_t hash, T value)
+{
+    return Fnv1a(&value, sizeof(T), hash);
+}
+
+uint64_t VolumeCacheKey(const BakeSettings& settings)
+{
+    uint64_t hash = FNV1A_BASIS;
+    hash = hash_value(hash, BAKE_KERNEL_VERSION);
+    hash = hash_value(hash, CODEC_VERSION);
+    hash = hash_value(hash, settings.field);
+    hash = hash_value(hash, settings.resolution);
+    for (int i = 0; i < 3; ++i)
+    {
+        hash = hash_value(hash, settings.bounds_min[i]);
+        hash = hash_value(hash, settings.bounds_max[i]);
+    }
+    hash = hash_value(hash, settings.fractal.type);
+    hash = hash_value(hash, settings.fractal.order);
+    hash = hash_value(hash, settings.fractal.max_iterations);
+    if (settings.field == BAKE_DISTANCE)
+    {
+        hash = hash_value(hash, settings.distance_band);
+    }
+    if (settings.strategy != BAKE_EVERY_VOXEL)
+    {
+        hash = hash_value(hash, settings.strategy);
+    }
+    return hash;
+}
+
+float VolumeCacheMaxError(const BakeSettings& settings)
+{
+    return settings.field == BAKE_DISTANCE ? 0.125f / float(settings.resolution) : CODEC_DEFAULT_MAX_ERROR;
+}
+
+VolumeCache::VolumeCache(const std::string& directory, size_t memoryBudget, uint64_t diskBudget)
+    : m_directory(directory), m_memoryBudget(memoryBudget), m_diskBudget(diskBudget)
+{
+}
+
+std::string VolumeCachePath(const std::string& directory, const BakeSettings& settings)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.fbz", (unsigned long long)VolumeCacheKey(settings));
+    return (fs::path(directory) / name).string();
+}
+
+std::shared_ptr<const BrickMap> VolumeCache::find(const BakeSettings& settings)
+{
+    uint64_t key = VolumeCacheKey(settings);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->volume;
+        }
+    }
+
+    // The header check in LoadCompressedVolume also catches the rare hash collision
+    std::string path = VolumeCachePath(m_directory, settings);
+    auto volume = std::make_shared<BrickMap>();
+    if (!LoadCompressedVolume(path, settings, *volume, settings.threads))
+    {
+        return nullptr;
+    }
+
+    // Touching the file keeps it at the young end of the disk eviction order
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertLocked(key, volume);
+    return volume;
+}
+
+void VolumeCache::store(const BakeSettings& settings, std::shared_ptr<const BrickMap> volume)
+{
+    uint64_t key = VolumeCacheKey(settings);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        insertLocked(key, volume);
+    }
+
+    std::lock_guard<std::mutex> lock(m_diskMutex);
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+    if (SaveCompressedVolume(*volume, settings, VolumeCachePath(m_directory, settings), VolumeCacheMaxError(settings), settings.threads))
+    {
+        trimDisk();
+    }
+}
+
+size_t VolumeCache::memoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBytes;
+}
+
+void VolumeCache::insertLocked(uint64_t key, std::shared_ptr<const BrickMap> volume)
+{
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        m_memoryBytes -= it->second->bytes;
+        m_lru.erase(it->second);
+        m_entries.erase(it);
+    }
+
+    size_t bytes = volume->memoryBytes();
+    m_lru.push_front(Entry{ key, std::move(volume), bytes });
+    m_entries[key] = m_lru.begin();
+    m_memoryBytes += bytes;
+
+    // The newest entry stays even if it alone is over budget
+    while (m_memoryBytes > m_memoryBudget && m_lru.size() > 1)
+    {
+        m_memoryBytes -= m_lru.back().bytes;
+        m_entries.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+}
+
+// Deletes the least recently written or read files until the directory fits the disk budget
+void VolumeCache::trimDisk()
+{
+    struct CacheFile
+    {
+        fs::path path;
+        fs::file_time_type time;
+        uint64_t bytes;
+    };
+    std::vector<CacheFile> files;
+    uint64_t total = 0;
+
+    std::error_code error;
+    for (const fs::directory_entry& entry : fs::directory_iterator(m_directory, error))
+    {
+        if (entry.path().extension() != ".fbz" || !entry.is_regular_file(error))
+        {
+            continue;
+        }
+        CacheFile file{ entry.path(), entry.last_write_time(error), entry.file_size(error) };
+        total += file.bytes;
+        files.push_back(file);
+    }
+
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.time < b.time; });
+    for (size_t i = 0; total > m_diskBudget && i + 1 < files.size(); ++i)
+    {
+        if (fs::remove(files[i].path, error))
+        {
+            total -= files[i].bytes;
+        }
+    }
+}
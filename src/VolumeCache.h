@@ -0,0 +1,68 @@
+#pragma once
+
+#include "BrickMap.h"
+#include "VoxelBaker.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Hash of everything that changes a bake's voxels: field, resolution, bounds, fractal parameters,
+// distance band, bake strategy, BAKE_KERNEL_VERSION and the cache file format. Thread count, job
+// size, SIMD level, symmetry and intervals only change how fast the same voxels come out, so they
+// are left out.
+uint64_t VolumeCacheKey(const BakeSettings& settings);
+
+// File the disk tier of a VolumeCache on directory keeps the bake of settings in
+std::string VolumeCachePath(const std::string& directory, const BakeSettings& settings);
+
+// Error bound cache files are encoded with. Distances keep an eighth of a voxel so sphere traced
+// hits don't move; densities only need to keep their 1 / max_iterations steps apart.
+float VolumeCacheMaxError(const BakeSettings& settings);
+
+// Content-addressed store of baked volumes in two tiers: the most recently used volumes stay in
+// memory, and every volume is also written to <directory>/<key>.fbz as a compressed volume
+// (VolumeCodec.h). Each tier evicts its least recently used entries once it grows past its budget.
+// Safe to use from several threads.
+class VolumeCache
+{
+public:
+    VolumeCache(const std::string& directory, size_t memoryBudget, uint64_t diskBudget);
+
+    VolumeCache(const VolumeCache&) = delete;
+    VolumeCache& operator=(const VolumeCache&) = delete;
+
+    // The volume baked with settings, from memory or else from disk, or nullptr if neither has it
+    std::shared_ptr<const BrickMap> find(const BakeSettings& settings);
+
+    // Adds a finished bake of settings to both tiers
+    void store(const BakeSettings& settings, std::shared_ptr<const BrickMap> volume);
+
+    size_t memoryBytes() const;
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::shared_ptr<const BrickMap> volume;
+        size_t bytes;
+    };
+
+    void insertLocked(uint64_t key, std::shared_ptr<const BrickMap> volume);
+    void trimDisk();
+
+    std::string m_directory;
+    size_t m_memoryBudget;
+    uint64_t m_diskBudget;
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_lru;     // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_entries;
+    size_t m_memoryBytes = 0;
+
+    // Serializes disk writes and eviction, kept apart from m_mutex so memory hits never wait on the disk
+    std::mutex m_diskMutex;
+};
@@ -0,0 +1,489 @@
+#include "VolumeCodec.h"
+
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "Serialization.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Layout: magic | header fields in VolumeHeader order | payload | index
+// The payload holds the coded bricks back to back in brick order. The index has one entry per
+// brick in the same order: uint8 kind, then float value for constant bricks, or float min,
+// float step and uint32 payload bytes. It comes last so a volume can be written as it is baked.
+static const char CODEC_MAGIC[4] = { 'F', 'B', 'Z', 'V' };
+static const size_t HEADER_BYTES = sizeof(CODEC_MAGIC) + 4 * 3 + 4 * 6 + 4 * 3 + 4 * 2 + 8 * 3;
+
+static void put_header(std::vector<uint8_t>& out, const VolumeHeader& header)
+{
+    out.insert(out.end(), CODEC_MAGIC, CODEC_MAGIC + sizeof(CODEC_MAGIC));
+    PutValue(out, header.version);
+    PutValue(out, int32_t(header.resolution));
+    PutValue(out, int32_t(header.field));
+    for (int i = 0; i < 3; ++i)
+    {
+        PutValue(out, header.bounds_min[i]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        PutValue(out, header.bounds_max[i]);
+    }
+    PutValue(out, int32_t(header.fractal.type));
+    PutValue(out, header.fractal.order);
+    PutValue(out, int32_t(header.fractal.max_iterations));
+    PutValue(out, header.distance_band);
+    PutValue(out, header.max_error);
+    PutValue(out, header.index_bytes);
+    PutValue(out, header.payload_bytes);
+    PutValue(out, header.checksum);
+}
+
+// Signed deltas to unsigned so small negative ones stay short: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+static uint32_t zigzag(int32_t v)   { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+static int32_t unzigzag(uint32_t v) { return int32_t(v >> 1) ^ -int32_t(v & 1); }
+
+// Delta codes q. A token of 0 is followed by the length of a run of zero deltas,
+// any other token is zigzag(delta) for a single voxel.
+static void encode_deltas(const uint32_t* q, std::vector<uint8_t>& out)
+{
+    uint32_t previous = 0;
+    for (int i = 0; i < BRICK_VOXELS;)
+    {
+        if (q[i] == previous)
+        {
+            int run = 1;
+            while (i + run < BRICK_VOXELS && q[i + run] == previous)
+            {
+                ++run;
+            }
+            PutVarint(out, 0);
+            PutVarint(out, uint32_t(run));
+            i += run;
+            continue;
+        }
+        PutVarint(out, zigzag(int32_t(q[i]) - int32_t(previous)));
+        previous = q[i++];
+    }
+}
+
+static bool decode_deltas(const uint8_t* in, const uint8_t* end, uint32_t* q)
+{
+    uint32_t previous = 0;
+    for (int i = 0; i < BRICK_VOXELS;)
+    {
+        uint32_t token;
+        if (!GetVarint(in, end, token))
+        {
+            return false;
+        }
+        if (token == 0)
+        {
+            uint32_t run;
+            if (!GetVarint(in, end, run) || run > uint32_t(BRICK_VOXELS - i))
+            {
+                return false;
+            }
+            std::fill(q + i, q + i + run, previous);
+            i += run;
+            continue;
+        }
+        previous = uint32_t(int32_t(previous) + unzigzag(token));
+        q[i++] = previous;
+    }
+    return in == end;
+}
+
+void EncodeBrick(const BrickMap& volume, size_t brick, float maxError, std::vector<uint8_t>& index, std::vector<uint8_t>& payload)
+{
+    if (volume.isConstant(brick))
+    {
+        PutValue(index, BRICK_CONSTANT);
+        PutValue(index, volume.constantValue(brick));
+        return;
+    }
+
+    const float* voxels = volume.brickData(brick);
+    auto bounds = std::minmax_element(voxels, voxels + BRICK_VOXELS);
+    float lo = *bounds.first, range = *bounds.second - lo;
+
+    size_t start = payload.size();
+    uint8_t kind;
+    float step = 0.f;
+    if (range / 255.0f * 0.5f <= maxError)
+    {
+        kind = BRICK_QUANTIZED_8;
+        step = range / 255.0f;
+    }
+    else if (range / 65535.0f * 0.5f <= maxError)
+    {
+        kind = BRICK_QUANTIZED_16;
+        step = range / 65535.0f;
+    }
+    else
+    {
+        kind = BRICK_RAW;
+        payload.resize(start + BRICK_VOXELS * sizeof(float));
+        memcpy(payload.data() + start, voxels, BRICK_VOXELS * sizeof(float));
+    }
+
+    if (kind != BRICK_RAW)
+    {
+        uint32_t q[BRICK_VOXELS];
+        for (int i = 0; i < BRICK_VOXELS; ++i)
+        {
+            q[i] = uint32_t(lrintf((voxels[i] - lo) / step));
+        }
+        encode_deltas(q, payload);
+    }
+
+    PutValue(index, kind);
+    PutValue(index, lo);
+    PutValue(index, step);
+    PutValue(index, uint32_t(payload.size() - start));
+}
+
+// Codes bricks [first, end) of volume, appending their index entries and payload in brick order.
+// Every layer of bricks is coded into its own buffers on the JobSystem, which are then joined.
+static void encode_bricks(const BrickMap& volume, size_t first, size_t end, float maxError, int threadCount,
+                          std::vector<uint8_t>& index, std::vector<uint8_t>& payload)
+{
+    size_t per_layer = (size_t)volume.bricksPerSide() * volume.bricksPerSide();
+    size_t layers = (end - first + per_layer - 1) / per_layer;
+    std::vector<std::vector<uint8_t>> layer_index(layers), layer_payload(layers);
+
+    std::vector<std::vector<JobSystem::Job>> jobs(layers);
+    for (size_t z = 0; z < layers; ++z)
+    {
+        jobs[z].push_back([&, z]
+        {
+            size_t layer_end = std::min(end, first + (z + 1) * per_layer);
+            for (size_t brick = first + z * per_layer; brick < layer_end; ++brick)
+            {
+                EncodeBrick(volume, brick, maxError, layer_index[z], layer_payload[z]);
+            }
+        });
+    }
+    JobSystem pool(threadCount);
+    pool.run(jobs);
+
+    for (size_t z = 0; z < layers; ++z)
+    {
+        index.insert(index.end(), layer_index[z].begin(), layer_index[z].end());
+        payload.insert(payload.end(), layer_payload[z].begin(), layer_payload[z].end());
+    }
+}
+
+static VolumeHeader describe(const BakeSettings& source, int resolution, float maxError)
+{
+    VolumeHeader header;
+    header.resolution = resolution;
+    header.field = source.field;
+    header.bounds_min = source.bounds_min;
+    header.bounds_max = source.bounds_max;
+    header.fractal = source.fractal;
+    header.distance_band = source.distance_band;
+    header.max_error = maxError;
+    return header;
+}
+
+bool DecodeBrick(const uint8_t* data, const CodedBrick& coded, float* voxels)
+{
+    return DecodeBrickPayload(data + HEADER_BYTES, coded, voxels);
+}
+
+bool DecodeBrickPayload(const uint8_t* payload, const CodedBrick& coded, float* voxels)
+{
+    const uint8_t* in = payload + coded.offset;
+    if (coded.kind == BRICK_CONSTANT)
+    {
+        std::fill(voxels, voxels + BRICK_VOXELS, coded.value);
+        return true;
+    }
+    if (coded.kind == BRICK_RAW)
+    {
+        if (coded.bytes != BRICK_VOXELS * sizeof(float))
+        {
+            return false;
+        }
+        memcpy(voxels, in, BRICK_VOXELS * sizeof(float));
+        return true;
+    }
+
+    uint32_t q[BRICK_VOXELS];
+    if (!decode_deltas(in, in + coded.bytes, q))
+    {
+        return false;
+    }
+    for (int i = 0; i < BRICK_VOXELS; ++i)
+    {
+        voxels[i] = coded.value + float(q[i]) * coded.step;
+    }
+    return true;
+}
+
+bool ReadVolumeHeader(const uint8_t* data, size_t size, VolumeHeader& header)
+{
+    if (size < HEADER_BYTES || memcmp(data, CODEC_MAGIC, sizeof(CODEC_MAGIC)) != 0)
+    {
+        return false;
+    }
+    const uint8_t* in = data + sizeof(CODEC_MAGIC);
+    const uint8_t* end = data + HEADER_BYTES;
+    int32_t resolution, field, type, iterations;
+    VolumeHeader read;
+    GetValue(in, end, read.version);
+    if (read.version != CODEC_VERSION)
+    {
+        return false;
+    }
+    GetValue(in, end, resolution);
+    GetValue(in, end, field);
+    for (int i = 0; i < 3; ++i)
+    {
+        GetValue(in, end, read.bounds_min[i]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        GetValue(in, end, read.bounds_max[i]);
+    }
+    GetValue(in, end, type);
+    GetValue(in, end, read.fractal.order);
+    GetValue(in, end, iterations);
+    GetValue(in, end, read.distance_band);
+    GetValue(in, end, read.max_error);
+    GetValue(in, end, read.index_bytes);
+    GetValue(in, end, read.payload_bytes);
+    GetValue(in, end, read.checksum);
+    read.resolution = resolution;
+    read.field = field;
+    read.fractal.type = type;
+    read.fractal.max_iterations = iterations;
+
+    if (read.resolution <= 0 || read.index_bytes + read.payload_bytes != (uint64_t)(size - HEADER_BYTES))
+    {
+        return false;
+    }
+    header = read;
+    return true;
+}
+
+bool HeaderMatches(const VolumeHeader& header, const BakeSettings& settings)
+{
+    return header.resolution == settings.resolution &&
+        header.field == settings.field &&
+        header.bounds_min == settings.bounds_min &&
+        header.bounds_max == settings.bounds_max &&
+        header.fractal.type == settings.fractal.type &&
+        header.fractal.order == settings.fractal.order &&
+        header.fractal.max_iterations == settings.fractal.max_iterations &&
+        (settings.field != BAKE_DISTANCE || header.distance_band == settings.distance_band);
+}
+
+bool ReadBrickEntry(const uint8_t*& in, const uint8_t* end, CodedBrick& coded)
+{
+    if (!GetValue(in, end, coded.kind) || coded.kind > BRICK_RAW || !GetValue(in, end, coded.value))
+    {
+        return false;
+    }
+    coded.step = 0.f;
+    coded.offset = 0;
+    coded.bytes = 0;
+    return coded.kind == BRICK_CONSTANT || (GetValue(in, end, coded.step) && GetValue(in, end, coded.bytes));
+}
+
+bool ReadVolumeIndex(const uint8_t* data, const VolumeHeader& header, std::vector<CodedBrick>& bricks)
+{
+    size_t side = ((size_t)header.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    bricks.resize(side * side * side);
+
+    // The index has variable length entries, so it is read serially to find every payload offset
+    const uint8_t* in = data + HEADER_BYTES + header.payload_bytes;
+    const uint8_t* end = in + header.index_bytes;
+    uint64_t offset = 0;
+    for (CodedBrick& coded : bricks)
+    {
+        if (!ReadBrickEntry(in, end, coded))
+        {
+            return false;
+        }
+        coded.offset = offset;
+        offset += coded.bytes;
+    }
+    return in == end && offset == header.payload_bytes;
+}
+
+bool DecodeVolume(const uint8_t* data, size_t size, BrickMap& volume, int threadCount)
+{
+    VolumeHeader header;
+    std::vector<CodedBrick> bricks;
+    if (!ReadVolumeHeader(data, size, header) || Fnv1a(data + HEADER_BYTES, size - HEADER_BYTES) != header.checksum ||
+        !ReadVolumeIndex(data, header, bricks))
+    {
+        return false;
+    }
+
+    BrickMap decoded(header.resolution);
+    int slabs = decoded.bricksPerSide();
+    size_t per_slab = (size_t)slabs * slabs;
+    std::atomic<bool> corrupt{ false };
+    std::vector<std::vector<JobSystem::Job>> jobs(slabs);
+    for (int z = 0; z < slabs; ++z)
+    {
+        jobs[z].push_back([&, z]
+        {
+            float voxels[BRICK_VOXELS];
+            for (size_t brick = z * per_slab; brick < (z + 1) * per_slab; ++brick)
+            {
+                const CodedBrick& coded = bricks[brick];
+                if (coded.isConstant())
+                {
+                    decoded.setConstant(brick, coded.value);
+                }
+                else if (DecodeBrick(data, coded, voxels))
+                {
+                    decoded.setBrick(brick, voxels);
+                }
+                else
+                {
+                    corrupt = true;
+                }
+            }
+        });
+    }
+    JobSystem pool(threadCount);
+    pool.run(jobs);
+    if (corrupt)
+    {
+        return false;
+    }
+
+    volume = std::move(decoded);
+    return true;
+}
+
+VolumeWriter::~VolumeWriter()
+{
+    if (m_out.is_open())
+    {
+        m_out.close();
+        std::error_code error;
+        std::filesystem::remove(m_path + ".tmp", error);
+    }
+}
+
+bool VolumeWriter::open(const std::string& path, const BakeSettings& source, float maxError, int threadCount)
+{
+    m_path = path;
+    m_out.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!m_out.is_open())
+    {
+        std::cerr << "Failed to write " << path << ".tmp" << std::endl;
+        return false;
+    }
+
+    // Written again with the sizes and checksum by finish()
+    m_header = describe(source, source.resolution, maxError);
+    std::vector<uint8_t> header;
+    put_header(header, m_header);
+    m_out.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    m_index.clear();
+    m_nextBrick = 0;
+    m_threadCount = threadCount;
+    m_header.checksum = Fnv1a(nullptr, 0);
+    return m_out.good();
+}
+
+bool VolumeWriter::append(const BrickMap& volume, size_t first, size_t end)
+{
+    if (!m_out.is_open() || first != m_nextBrick || volume.resolution() != m_header.resolution)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> payload;
+    encode_bricks(volume, first, end, m_header.max_error, m_threadCount, m_index, payload);
+    m_out.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    m_header.payload_bytes += payload.size();
+    m_header.checksum = Fnv1a(payload.data(), payload.size(), m_header.checksum);
+    m_nextBrick = end;
+    return m_out.good();
+}
+
+bool VolumeWriter::finish()
+{
+    size_t side = ((size_t)m_header.resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    if (!m_out.is_open() || m_nextBrick != side * side * side)
+    {
+        return false;
+    }
+
+    m_out.write(reinterpret_cast<const char*>(m_index.data()), m_index.size());
+    m_header.index_bytes = m_index.size();
+    m_header.checksum = Fnv1a(m_index.data(), m_index.size(), m_header.checksum);
+    std::vector<uint8_t> header;
+    put_header(header, m_header);
+    m_out.seekp(0);
+    m_out.write(reinterpret_cast<const char*>(header.data()), header.size());
+    bool written = m_out.good();
+    m_out.close();
+    std::vector<uint8_t>().swap(m_index);
+
+    std::string temporary = m_path + ".tmp";
+    std::error_code error;
+    if (!written)
+    {
+        std::cerr << "Failed to write " << temporary << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    std::filesystem::rename(temporary, m_path, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace " << m_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+bool SaveCompressedVolume(const BrickMap& volume, const BakeSettings& source, const std::string& path, float maxError, int threadCount)
+{
+    BakeSettings described = source;
+    described.resolution = volume.resolution();
+
+    VolumeWriter writer;
+    return writer.open(path, described, maxError, threadCount) && writer.append(volume, 0, volume.brickCount()) && writer.finish();
+}
+
+bool LoadCompressedVolume(const std::string& path, const BakeSettings& expected, BrickMap& volume, int threadCount)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return false;
+    }
+
+    VolumeHeader header;
+    if (!ReadVolumeHeader(file.data(), file.size(), header))
+    {
+        std::cerr << path << " is not a version " << CODEC_VERSION << " compressed volume" << std::endl;
+        return false;
+    }
+    if (!HeaderMatches(header, expected))
+    {
+        std::cerr << path << " was baked with different settings" << std::endl;
+        return false;
+    }
+    if (!DecodeVolume(file.data(), file.size(), volume, threadCount))
+    {
+        std::cerr << path << " is damaged" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "BrickMap.h"
+#include "VoxelBaker.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Lossy compression for brick maps, used for the on-disk volume cache.
+//
+// Constant bricks cost one byte plus their value. Every other brick is quantized to 8 bits, or
+// to 16 bits when 8 can't meet the error bound, between its own min and max. The quantized
+// values are delta coded in voxel order, and the deltas are zigzag varints with runs of zero
+// deltas (the long flat stretches of 0 and 1 density) collapsed into a single run length.
+// Bricks whose range is too wide even for 16 bits are stored as raw floats.
+//
+// Encoding and decoding split the bricks into z-slabs and run them on a JobSystem.
+
+// Bumped whenever the layout or the meaning of the stored values changes
+const uint32_t CODEC_VERSION = 3;
+
+// Half a step of 8-bit quantization over the [0, 1] density range, so dense density bricks
+// always fit in 8 bits
+const float CODEC_DEFAULT_MAX_ERROR = 0.5f / 255.0f;
+
+// Fixed size header at the start of every encoded volume, recording what was baked into it
+struct VolumeHeader
+{
+    uint32_t version = CODEC_VERSION;
+    int resolution = 0;
+    int field = BAKE_DENSITY;
+    glm::vec3 bounds_min = glm::vec3(0.f);
+    glm::vec3 bounds_max = glm::vec3(0.f);
+    FractalParams fractal;
+    float distance_band = 0.f;
+    float max_error = 0.f;
+    uint64_t index_bytes = 0;
+    uint64_t payload_bytes = 0;
+    uint64_t checksum = 0;      // FNV-1a over the index and the payload
+};
+
+enum BrickKind : uint8_t
+{
+    BRICK_CONSTANT = 0,
+    BRICK_QUANTIZED_8 = 1,
+    BRICK_QUANTIZED_16 = 2,
+    BRICK_RAW = 3
+};
+
+// Where and how one brick of an encoded volume is stored, see ReadVolumeIndex()
+struct CodedBrick
+{
+    uint8_t kind;
+    float value;        // constant value, or the quantization minimum
+    float step;
+    uint64_t offset;    // into the payload
+    uint32_t bytes;
+
+    bool isConstant() const { return kind == BRICK_CONSTANT; }
+};
+
+// Appends the index entry of one brick to index and its coded voxels, if any, to payload
+void EncodeBrick(const BrickMap& volume, size_t brick, float maxError, std::vector<uint8_t>& index, std::vector<uint8_t>& payload);
+
+// Reads one index entry written by EncodeBrick() and advances in past it. offset is left at 0
+// for the caller to fill in.
+bool ReadBrickEntry(const uint8_t*& in, const uint8_t* end, CodedBrick& coded);
+
+// Decodes one brick whose coded.offset is relative to payload, false if its payload is damaged
+bool DecodeBrickPayload(const uint8_t* payload, const CodedBrick& coded, float* voxels);
+
+// Reads the header without touching the rest of the data. False if data isn't an encoded volume
+// of this CODEC_VERSION or is shorter than the header says.
+bool ReadVolumeHeader(const uint8_t* data, size_t size, VolumeHeader& header);
+
+// True if header describes a bake of settings (threads, brick size and SIMD don't change the result)
+bool HeaderMatches(const VolumeHeader& header, const BakeSettings& settings);
+
+// Reads the brick index of an encoded volume whose header has already been read, false if it is damaged
+bool ReadVolumeIndex(const uint8_t* data, const VolumeHeader& header, std::vector<CodedBrick>& bricks);
+
+// Decodes one brick of the encoded volume starting at data, false if its payload is damaged
+bool DecodeBrick(const uint8_t* data, const CodedBrick& coded, float* voxels);
+
+// Replaces volume with the decoded data, false if data is not a complete encoded volume or fails its checksum
+bool DecodeVolume(const uint8_t* data, size_t size, BrickMap& volume, int threadCount = 0);
+
+// Writes an encoded volume a range of bricks at a time, so a volume never has to be in memory as
+// a whole. Bricks are appended in brick order and coded as they arrive; finish() adds the index,
+// fills in the header and renames the file into place. An unfinished file is deleted.
+class VolumeWriter
+{
+public:
+    VolumeWriter() = default;
+    ~VolumeWriter();
+
+    VolumeWriter(const VolumeWriter&) = delete;
+    VolumeWriter& operator=(const VolumeWriter&) = delete;
+
+    // Starts a source.resolution^3 volume baked with source at a temporary file next to path
+    bool open(const std::string& path, const BakeSettings& source, float maxError = CODEC_DEFAULT_MAX_ERROR, int threadCount = 0);
+
+    // Codes bricks [first, end) of volume. first has to be where the previous append ended.
+    bool append(const BrickMap& volume, size_t first, size_t end);
+
+    bool finish();
+
+private:
+    std::string m_path;
+    std::ofstream m_out;
+    VolumeHeader m_header;
+    std::vector<uint8_t> m_index;
+    size_t m_nextBrick = 0;
+    int m_threadCount = 0;
+};
+
+// Writes to a temporary file next to path and renames it into place, so readers never see half a file
+bool SaveCompressedVolume(const BrickMap& volume, const BakeSettings& source, const std::string& path, float maxError = CODEC_DEFAULT_MAX_ERROR, int threadCount = 0);
+
+// Maps the file and decodes straight from the mapping. Files from another version or another
+// bake are rejected from their header alone.
+bool LoadCompressedVolume(const std::string& path, const BakeSettings& expected, BrickMap& volume, int threadCount = 0);
@@ -0,0 +1,187 @@
+#include "VolumeMemory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<bool> large_pages_used{ false };
+
+bool VolumeMemoryUsesLargePages()
+{
+    return large_pages_used;
+}
+
+#ifdef _WIN32
+
+int VolumeMemoryNodeCount()
+{
+    static const int count = []
+    {
+        ULONG highest = 0;
+        return GetNumaHighestNodeNumber(&highest) ? int(highest) + 1 : 1;
+    }();
+    return count;
+}
+
+int CurrentVolumeMemoryNode()
+{
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node = 0;
+    if (!GetNumaProcessorNodeEx(&processor, &node) || node >= VolumeMemoryNodeCount())
+    {
+        return 0;
+    }
+    return node;
+}
+
+// Large pages need SeLockMemoryPrivilege ("Lock pages in memory"), which has to be granted to the
+// user and then enabled in the process token. Without it every allocation uses 4 KB pages.
+static bool enable_large_pages()
+{
+    static const bool enabled = []
+    {
+        if (GetLargePageMinimum() == 0 || VOLUME_PAGE_BYTES % GetLargePageMinimum() != 0)
+        {
+            return false;
+        }
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool granted = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+                       AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+        CloseHandle(token);
+        return granted;
+    }();
+    return enabled;
+}
+
+void* AllocateVolumeMemory(size_t bytes, int node)
+{
+    DWORD preferred = VolumeMemoryNodeCount() > 1 ? DWORD(node) : NUMA_NO_PREFERRED_NODE;
+    void* memory = nullptr;
+    if (enable_large_pages())
+    {
+        memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, preferred);
+        if (memory)
+        {
+            large_pages_used = true;
+            return memory;
+        }
+    }
+    memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, preferred);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void FreeVolumeMemory(void* memory, size_t)
+{
+    if (memory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+}
+
+#else
+
+// Not in every libc's headers, from linux/mempolicy.h
+static const int MPOL_PREFERRED_NODE = 1;
+
+int VolumeMemoryNodeCount()
+{
+    // "0" or "0-1"
+    static const int count = []
+    {
+        std::ifstream in("/sys/devices/system/node/possible");
+        std::string nodes;
+        if (!(in >> nodes))
+        {
+            return 1;
+        }
+        size_t dash = nodes.find('-');
+        return dash == std::string::npos ? 1 : std::max(1, std::atoi(nodes.c_str() + dash + 1) + 1);
+    }();
+    return count;
+}
+
+int CurrentVolumeMemoryNode()
+{
+    unsigned int cpu = 0, node = 0;
+    if (VolumeMemoryNodeCount() == 1 || syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= (unsigned int)VolumeMemoryNodeCount())
+    {
+        return 0;
+    }
+    return (int)node;
+}
+
+void* AllocateVolumeMemory(size_t bytes, int node)
+{
+    // Explicit huge pages only exist if the administrator reserved some (vm.nr_hugepages)
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+        large_pages_used = true;
+    }
+    else
+    {
+        // Transparent huge pages only back page aligned ranges, so map a page more and trim
+        uint8_t* mapped = (uint8_t*)mmap(nullptr, bytes + VOLUME_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        uint8_t* aligned = (uint8_t*)(((uintptr_t)mapped + VOLUME_PAGE_BYTES - 1) & ~(uintptr_t)(VOLUME_PAGE_BYTES - 1));
+        if (aligned > mapped)
+        {
+            munmap(mapped, aligned - mapped);
+        }
+        munmap(aligned + bytes, mapped + VOLUME_PAGE_BYTES - aligned);
+        memory = aligned;
+#ifdef MADV_HUGEPAGE
+        if (madvise(memory, bytes, MADV_HUGEPAGE) == 0)
+        {
+            large_pages_used = true;
+        }
+#endif
+    }
+
+    // Before the first touch, so no page lands on another node
+    if (VolumeMemoryNodeCount() > 1 && node < 64)
+    {
+        unsigned long mask = 1ul << node;
+        syscall(SYS_mbind, memory, bytes, MPOL_PREFERRED_NODE, &mask, sizeof(mask) * 8, 0);
+    }
+    return memory;
+}
+
+void FreeVolumeMemory(void* memory, size_t bytes)
+{
+    if (memory)
+    {
+        munmap(memory, bytes);
+    }
+}
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// Memory for the brick pools of big volumes. Allocations are backed by 2 MB pages when the OS
+// hands them out (explicit large pages first, then transparent huge pages), so a multi-GB volume
+// takes a few thousand TLB entries instead of millions, and they are placed on one NUMA node.
+//
+// Bricks are written by the job system worker that bakes or decodes them, so allocating on the
+// node of the calling thread puts them next to the cores that produce them.
+
+// Large page size, allocations are whole multiples of it
+const size_t VOLUME_PAGE_BYTES = size_t(2) << 20;
+
+// Number of NUMA nodes of the machine, 1 without NUMA
+int VolumeMemoryNodeCount();
+
+// NUMA node of the core the calling thread runs on, in [0, VolumeMemoryNodeCount())
+int CurrentVolumeMemoryNode();
+
+// bytes (a multiple of VOLUME_PAGE_BYTES) of memory on node. Falls back to ordinary pages without
+// large pages, and throws std::bad_alloc like new when out of memory. Release with FreeVolumeMemory.
+void* AllocateVolumeMemory(size_t bytes, int node);
+void FreeVolumeMemory(void* memory, size_t bytes);
+
+// Whether any allocation so far got large pages, or had transparent huge pages enabled for it
+bool VolumeMemoryUsesLargePages();
@@ -0,0 +1,500 @@
+#include "VolumeSequence.h"
+
+#include "JobSystem.h"
+#include "Serialization.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// Layout: magic | header fields in SequenceHeader order | frames | frame table
+// A keyframe holds the index entries of every brick followed by their payload. Any other frame
+// starts with a varint count of stored bricks and a varint per brick of how far past the
+// previous stored brick (+ 1) it is, then their index entries and payload. The frame table has
+// one float order, uint64 offset, uint64 bytes, uint32 bricks per frame.
+static const char SEQUENCE_MAGIC[4] = { 'F', 'B', 'Z', 'Q' };
+static const size_t SEQUENCE_HEADER_BYTES = sizeof(SEQUENCE_MAGIC) + 4 * 4 + 4 * 6 + 4 * 6 + 8 * 2;
+static const size_t FRAME_ENTRY_BYTES = 4 + 8 + 8 + 4;
+
+static void put_header(std::vector<uint8_t>& out, const SequenceHeader& header)
+{
+    out.insert(out.end(), SEQUENCE_MAGIC, SEQUENCE_MAGIC + sizeof(SEQUENCE_MAGIC));
+    PutValue(out, header.version);
+    PutValue(out, header.codec_version);
+    PutValue(out, int32_t(header.resolution));
+    PutValue(out, int32_t(header.field));
+    for (int i = 0; i < 3; ++i)
+    {
+        PutValue(out, header.bounds_min[i]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        PutValue(out, header.bounds_max[i]);
+    }
+    PutValue(out, int32_t(header.fractal_type));
+    PutValue(out, int32_t(header.max_iterations));
+    PutValue(out, header.distance_band);
+    PutValue(out, header.max_error);
+    PutValue(out, int32_t(header.keyframe_interval));
+    PutValue(out, int32_t(header.frame_count));
+    PutValue(out, header.frame_bytes);
+    PutValue(out, header.checksum);
+}
+
+static bool read_header(const uint8_t* data, size_t size, SequenceHeader& header)
+{
+    if (size < SEQUENCE_HEADER_BYTES || memcmp(data, SEQUENCE_MAGIC, sizeof(SEQUENCE_MAGIC)) != 0)
+    {
+        return false;
+    }
+    const uint8_t* in = data + sizeof(SEQUENCE_MAGIC);
+    const uint8_t* end = data + SEQUENCE_HEADER_BYTES;
+    int32_t resolution, field, type, iterations, interval, count;
+    SequenceHeader read;
+    GetValue(in, end, read.version);
+    GetValue(in, end, read.codec_version);
+    GetValue(in, end, resolution);
+    GetValue(in, end, field);
+    for (int i = 0; i < 3; ++i)
+    {
+        GetValue(in, end, read.bounds_min[i]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        GetValue(in, end, read.bounds_max[i]);
+    }
+    GetValue(in, end, type);
+    GetValue(in, end, iterations);
+    GetValue(in, end, read.distance_band);
+    GetValue(in, end, read.max_error);
+    GetValue(in, end, interval);
+    GetValue(in, end, count);
+    GetValue(in, end, read.frame_bytes);
+    GetValue(in, end, read.checksum);
+    read.resolution = resolution;
+    read.field = field;
+    read.fractal_type = type;
+    read.max_iterations = iterations;
+    read.keyframe_interval = interval;
+    read.frame_count = count;
+
+    if (read.version != SEQUENCE_VERSION || read.codec_version != CODEC_VERSION || read.resolution <= 0 ||
+        read.keyframe_interval <= 0 || read.frame_count <= 0 ||
+        read.frame_bytes + (uint64_t)read.frame_count * FRAME_ENTRY_BYTES != (uint64_t)(size - SEQUENCE_HEADER_BYTES))
+    {
+        return false;
+    }
+    header = read;
+    return true;
+}
+
+// True if any voxel of brick differs by more than maxError between a and b
+static bool brick_differs(const BrickMap& a, const BrickMap& b, size_t brick, float maxError)
+{
+    if (a.isConstant(brick) && b.isConstant(brick))
+    {
+        return std::fabs(a.constantValue(brick) - b.constantValue(brick)) > maxError;
+    }
+    float va[BRICK_VOXELS], vb[BRICK_VOXELS];
+    a.readBrick(brick, va);
+    b.readBrick(brick, vb);
+    for (int i = 0; i < BRICK_VOXELS; ++i)
+    {
+        if (std::fabs(va[i] - vb[i]) > maxError)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+VolumeSequenceWriter::~VolumeSequenceWriter()
+{
+    if (m_out.is_open())
+    {
+        m_out.close();
+        std::error_code error;
+        std::filesystem::remove(m_path + ".tmp", error);
+    }
+}
+
+bool VolumeSequenceWriter::open(const std::string& path, const BakeSettings& source, int keyframeInterval, float maxError, int threadCount)
+{
+    m_path = path;
+    m_out.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!m_out.is_open())
+    {
+        std::cerr << "Failed to write " << path << ".tmp" << std::endl;
+        return false;
+    }
+
+    m_header = SequenceHeader();
+    m_header.resolution = source.resolution;
+    m_header.field = source.field;
+    m_header.bounds_min = source.bounds_min;
+    m_header.bounds_max = source.bounds_max;
+    m_header.fractal_type = source.fractal.type;
+    m_header.max_iterations = source.fractal.max_iterations;
+    m_header.distance_band = source.distance_band;
+    m_header.max_error = maxError;
+    m_header.keyframe_interval = std::max(keyframeInterval, 1);
+
+    // Written again with the frame count and checksum by finish()
+    std::vector<uint8_t> header;
+    put_header(header, m_header);
+    m_out.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    m_header.checksum = Fnv1a(nullptr, 0);
+    m_frames.clear();
+    m_shown = BrickMap(source.resolution);
+    m_threadCount = threadCount;
+    return m_out.good();
+}
+
+bool VolumeSequenceWriter::append(const BrickMap& volume, float order)
+{
+    if (!m_out.is_open() || volume.resolution() != m_header.resolution)
+    {
+        return false;
+    }
+
+    // Every layer of bricks picks and codes its bricks into its own buffers, which are then joined.
+    // Each stored brick is decoded back into m_shown, so later frames are compared against what a
+    // player will actually show rather than the exact bake, and the error never accumulates.
+    bool keyframe = m_frames.size() % (size_t)m_header.keyframe_interval == 0;
+    size_t per_layer = (size_t)volume.bricksPerSide() * volume.bricksPerSide();
+    int layers = volume.bricksPerSide();
+    std::vector<std::vector<size_t>> layer_bricks(layers);
+    std::vector<std::vector<uint8_t>> layer_index(layers), layer_payload(layers);
+    std::vector<std::vector<JobSystem::Job>> jobs(layers);
+    for (int z = 0; z < layers; ++z)
+    {
+        jobs[z].push_back([&, z]
+        {
+            float voxels[BRICK_VOXELS];
+            for (size_t brick = z * per_layer; brick < (z + 1) * per_layer; ++brick)
+            {
+                if (!keyframe && !brick_differs(volume, m_shown, brick, m_header.max_error))
+                {
+                    continue;
+                }
+                std::vector<uint8_t>& index = layer_index[z];
+                std::vector<uint8_t>& payload = layer_payload[z];
+                size_t index_at = index.size(), payload_at = payload.size();
+                EncodeBrick(volume, brick, m_header.max_error, index, payload);
+
+                const uint8_t* in = index.data() + index_at;
+                CodedBrick coded;
+                ReadBrickEntry(in, index.data() + index.size(), coded);
+                coded.offset = payload_at;
+                DecodeBrickPayload(payload.data(), coded, voxels);
+                m_shown.setBrick(brick, voxels);
+                layer_bricks[z].push_back(brick);
+            }
+        });
+    }
+    JobSystem pool(m_threadCount);
+    pool.run(jobs);
+
+    std::vector<uint8_t> record;
+    size_t count = 0;
+    for (const std::vector<size_t>& bricks : layer_bricks)
+    {
+        count += bricks.size();
+    }
+    if (!keyframe)
+    {
+        PutVarint(record, uint32_t(count));
+        size_t next = 0;
+        for (const std::vector<size_t>& bricks : layer_bricks)
+        {
+            for (size_t brick : bricks)
+            {
+                PutVarint(record, uint32_t(brick - next));
+                next = brick + 1;
+            }
+        }
+    }
+    for (const std::vector<uint8_t>& index : layer_index)
+    {
+        record.insert(record.end(), index.begin(), index.end());
+    }
+    for (const std::vector<uint8_t>& payload : layer_payload)
+    {
+        record.insert(record.end(), payload.begin(), payload.end());
+    }
+
+    SequenceFrame frame;
+    frame.order = order;
+    frame.offset = m_header.frame_bytes;
+    frame.bytes = record.size();
+    frame.bricks = uint32_t(count);
+    m_frames.push_back(frame);
+
+    m_out.write(reinterpret_cast<const char*>(record.data()), record.size());
+    m_header.frame_bytes += record.size();
+    m_header.checksum = Fnv1a(record.data(), record.size(), m_header.checksum);
+    return m_out.good();
+}
+
+bool VolumeSequenceWriter::finish()
+{
+    if (!m_out.is_open() || m_frames.empty())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> table;
+    for (const SequenceFrame& frame : m_frames)
+    {
+        PutValue(table, frame.order);
+        PutValue(table, frame.offset);
+        PutValue(table, frame.bytes);
+        PutValue(table, frame.bricks);
+    }
+    m_out.write(reinterpret_cast<const char*>(table.data()), table.size());
+    m_header.frame_count = (int)m_frames.size();
+    m_header.checksum = Fnv1a(table.data(), table.size(), m_header.checksum);
+    std::vector<uint8_t> header;
+    put_header(header, m_header);
+    m_out.seekp(0);
+    m_out.write(reinterpret_cast<const char*>(header.data()), header.size());
+    bool written = m_out.good();
+    m_out.close();
+    m_shown = BrickMap();
+
+    std::string temporary = m_path + ".tmp";
+    std::error_code error;
+    if (!written)
+    {
+        std::cerr << "Failed to write " << temporary << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    std::filesystem::rename(temporary, m_path, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace " << m_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+VolumeSequence::VolumeSequence() = default;
+VolumeSequence::~VolumeSequence() = default;
+
+bool VolumeSequence::open(const std::string& path, int threadCount)
+{
+    m_file.close();
+    m_frames.clear();
+    m_volume = nullptr;
+    m_current = -1;
+    if (!m_file.open(path))
+    {
+        return false;
+    }
+
+    const uint8_t* data = m_file.data();
+    if (!read_header(data, m_file.size(), m_header))
+    {
+        std::cerr << path << " is not a version " << SEQUENCE_VERSION << " volume sequence" << std::endl;
+        return false;
+    }
+    if (Fnv1a(data + SEQUENCE_HEADER_BYTES, m_file.size() - SEQUENCE_HEADER_BYTES) != m_header.checksum)
+    {
+        std::cerr << path << " is damaged" << std::endl;
+        return false;
+    }
+
+    m_frameData = data + SEQUENCE_HEADER_BYTES;
+    const uint8_t* in = m_frameData + m_header.frame_bytes;
+    const uint8_t* end = data + m_file.size();
+    m_frames.resize(m_header.frame_count);
+    for (SequenceFrame& frame : m_frames)
+    {
+        GetValue(in, end, frame.order);
+        GetValue(in, end, frame.offset);
+        GetValue(in, end, frame.bytes);
+        GetValue(in, end, frame.bricks);
+        if (frame.offset > m_header.frame_bytes || frame.bytes > m_header.frame_bytes - frame.offset)
+        {
+            std::cerr << path << " is damaged" << std::endl;
+            m_frames.clear();
+            return false;
+        }
+    }
+
+    m_volume = std::make_shared<BrickMap>(m_header.resolution);
+    m_changed.assign(m_volume->brickCount(), 0);
+    if (!m_jobs || (threadCount > 0 && m_jobs->threadCount() != threadCount))
+    {
+        m_jobs = std::make_unique<JobSystem>(threadCount);
+    }
+    return true;
+}
+
+int VolumeSequence::nearestFrame(float order) const
+{
+    int nearest = 0;
+    for (int frame = 1; frame < frameCount(); ++frame)
+    {
+        if (std::fabs(m_frames[frame].order - order) < std::fabs(m_frames[nearest].order - order))
+        {
+            nearest = frame;
+        }
+    }
+    return nearest;
+}
+
+BakeSettings VolumeSequence::settings() const
+{
+    BakeSettings settings;
+    settings.resolution = m_header.resolution;
+    settings.field = m_header.field;
+    settings.bounds_min = m_header.bounds_min;
+    settings.bounds_max = m_header.bounds_max;
+    settings.fractal.type = m_header.fractal_type;
+    settings.fractal.max_iterations = m_header.max_iterations;
+    settings.fractal.order = m_frames.empty() ? 0.f : m_frames[std::max(m_current, 0)].order;
+    settings.distance_band = m_header.distance_band;
+    return settings;
+}
+
+bool VolumeSequence::seek(int frame, std::vector<size_t>* changed)
+{
+    if (!m_volume || frame < 0 || frame >= frameCount())
+    {
+        return false;
+    }
+
+    // Carry on from the current frame if it is on the way, otherwise start over at the keyframe
+    int keyframe = frame - frame % m_header.keyframe_interval;
+    int from = m_current >= keyframe && m_current <= frame ? m_current + 1 : keyframe;
+
+    size_t first = changed ? changed->size() : 0;
+    bool ok = true;
+    for (int f = from; f <= frame && ok; ++f)
+    {
+        ok = applyFrame(f, changed);
+    }
+    if (changed)
+    {
+        for (size_t i = first; i < changed->size(); ++i)
+        {
+            m_changed[(*changed)[i]] = 0;
+        }
+    }
+
+    // A frame that failed halfway leaves the volume somewhere between two frames, the next seek
+    // starts over from a keyframe
+    m_current = ok ? frame : -1;
+    return ok;
+}
+
+bool VolumeSequence::applyFrame(int frame, std::vector<size_t>* changed)
+{
+    const SequenceFrame& entry = m_frames[frame];
+    const uint8_t* in = m_frameData + entry.offset;
+    const uint8_t* end = in + entry.bytes;
+    bool keyframe = frame % m_header.keyframe_interval == 0;
+    size_t brick_count = m_volume->brickCount();
+
+    std::vector<size_t> bricks;
+    if (keyframe)
+    {
+        bricks.resize(brick_count);
+        for (size_t brick = 0; brick < brick_count; ++brick)
+        {
+            bricks[brick] = brick;
+        }
+    }
+    else
+    {
+        uint32_t count;
+        if (!GetVarint(in, end, count) || count > brick_count)
+        {
+            return false;
+        }
+        bricks.resize(count);
+        size_t next = 0;
+        for (size_t& brick : bricks)
+        {
+            uint32_t skip;
+            if (!GetVarint(in, end, skip) || next + skip >= brick_count)
+            {
+                return false;
+            }
+            brick = next + skip;
+            next = brick + 1;
+        }
+    }
+
+    std::vector<CodedBrick> coded(bricks.size());
+    uint64_t offset = 0;
+    for (CodedBrick& c : coded)
+    {
+        if (!ReadBrickEntry(in, end, c))
+        {
+            return false;
+        }
+        c.offset = offset;
+        offset += c.bytes;
+    }
+    if (offset != (uint64_t)(end - in))
+    {
+        return false;
+    }
+    const uint8_t* payload = in;
+
+    // Runs of a few hundred bricks per job, each collecting the bricks it changed
+    const size_t per_job = 512;
+    size_t job_count = (bricks.size() + per_job - 1) / per_job;
+    std::vector<std::vector<size_t>> job_changed(job_count);
+    std::atomic<bool> corrupt{ false };
+    std::vector<std::vector<JobSystem::Job>> jobs(job_count);
+    for (size_t j = 0; j < job_count; ++j)
+    {
+        jobs[j].push_back([&, j]
+        {
+            float voxels[BRICK_VOXELS], current[BRICK_VOXELS];
+            size_t last = std::min(bricks.size(), (j + 1) * per_job);
+            for (size_t i = j * per_job; i < last; ++i)
+            {
+                size_t brick = bricks[i];
+                if (!DecodeBrickPayload(payload, coded[i], voxels))
+                {
+                    corrupt = true;
+                    continue;
+                }
+                if (changed)
+                {
+                    m_volume->readBrick(brick, current);
+                    if (memcmp(current, voxels, sizeof(voxels)) == 0)
+                    {
+                        continue;
+                    }
+                    if (!m_changed[brick])
+                    {
+                        m_changed[brick] = 1;
+                        job_changed[j].push_back(brick);
+                    }
+                }
+                m_volume->setBrick(brick, voxels);
+            }
+        });
+    }
+    m_jobs->run(jobs);
+
+    if (changed)
+    {
+        for (const std::vector<size_t>& list : job_changed)
+        {
+            changed->insert(changed->end(), list.begin(), list.end());
+        }
+    }
+    return !corrupt;
+}
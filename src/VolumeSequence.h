@@ -0,0 +1,125 @@
+#pragma once
+
+#include "BrickMap.h"
+#include "MappedFile.h"
+#include "VolumeCodec.h"
+#include "VoxelBaker.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+// Animated volumes: a run of bakes with the same settings except for fractal.order, stored as
+// keyframes plus brick-level deltas. Most bricks barely move between two neighbouring orders, so
+// a frame after the first only stores the bricks that drifted more than max_error away from what
+// the frames before it already show. Every keyframe_interval-th frame stores every brick, so any
+// frame can be reached by decoding at most one keyframe and the deltas after it.
+// Bricks are coded like the bricks of a compressed volume (VolumeCodec.h).
+
+// Bumped whenever the layout of a sequence file changes
+const uint32_t SEQUENCE_VERSION = 1;
+
+struct SequenceHeader
+{
+    uint32_t version = SEQUENCE_VERSION;
+    uint32_t codec_version = CODEC_VERSION;
+    int resolution = 0;
+    int field = BAKE_DENSITY;
+    glm::vec3 bounds_min = glm::vec3(0.f);
+    glm::vec3 bounds_max = glm::vec3(0.f);
+    int fractal_type = 0;
+    int max_iterations = 0;
+    float distance_band = 0.f;
+    float max_error = 0.f;
+    int keyframe_interval = 0;
+    int frame_count = 0;
+    uint64_t frame_bytes = 0;
+    uint64_t checksum = 0;      // FNV-1a over the frames and the frame table
+};
+
+struct SequenceFrame
+{
+    float order = 0.f;
+    uint64_t offset = 0;        // into the frame data
+    uint64_t bytes = 0;
+    uint32_t bricks = 0;        // bricks stored, every brick for a keyframe
+};
+
+// Writes a sequence a frame at a time, so only the frame being added and the state the player
+// will be in after the frames before it are ever in memory. Like VolumeWriter it writes to a
+// temporary file that finish() renames into place.
+class VolumeSequenceWriter
+{
+public:
+    VolumeSequenceWriter() = default;
+    ~VolumeSequenceWriter();
+
+    VolumeSequenceWriter(const VolumeSequenceWriter&) = delete;
+    VolumeSequenceWriter& operator=(const VolumeSequenceWriter&) = delete;
+
+    // Starts a sequence of source.resolution^3 bakes of source, fractal.order aside
+    bool open(const std::string& path, const BakeSettings& source, int keyframeInterval = 16, float maxError = CODEC_DEFAULT_MAX_ERROR, int threadCount = 0);
+
+    // Adds volume, the bake of source at order, as the next frame
+    bool append(const BrickMap& volume, float order);
+
+    bool finish();
+
+    // Frames appended so far
+    const std::vector<SequenceFrame>& frames() const { return m_frames; }
+
+private:
+    std::string m_path;
+    std::ofstream m_out;
+    SequenceHeader m_header;
+    std::vector<SequenceFrame> m_frames;
+    BrickMap m_shown;       // what a player shows after the frames written so far
+    int m_threadCount = 0;
+};
+
+// Plays a sequence file back from a memory mapping. The volume is updated in place from frame to
+// frame, and seek() reports which bricks it changed so only those have to be sent to the GPU.
+class VolumeSequence
+{
+public:
+    VolumeSequence();
+    ~VolumeSequence();
+
+    VolumeSequence(const VolumeSequence&) = delete;
+    VolumeSequence& operator=(const VolumeSequence&) = delete;
+
+    // Maps path and checks it, the volume is empty until the first seek()
+    bool open(const std::string& path, int threadCount = 0);
+
+    int frameCount() const                  { return (int)m_frames.size(); }
+    float frameOrder(int frame) const       { return m_frames[frame].order; }
+    int nearestFrame(float order) const;
+    int currentFrame() const                { return m_current; }
+
+    // Settings the current frame was baked with
+    BakeSettings settings() const;
+
+    // Moves the volume to frame, decoding only the frames between the current one and it, or
+    // between the keyframe before it and it. Bricks whose voxels changed are added to changed.
+    bool seek(int frame, std::vector<size_t>* changed = nullptr);
+
+    // Changes in place on every seek(), so don't seek while something is still reading it
+    std::shared_ptr<const BrickMap> volume() const { return m_volume; }
+
+private:
+    bool applyFrame(int frame, std::vector<size_t>* changed);
+
+    MappedFile m_file;
+    SequenceHeader m_header;
+    std::vector<SequenceFrame> m_frames;
+    const uint8_t* m_frameData = nullptr;
+    std::unique_ptr<JobSystem> m_jobs;      // kept so scrubbing doesn't start threads every frame
+
+    std::shared_ptr<BrickMap> m_volume;
+    std::vector<uint8_t> m_changed;     // per brick, already in the caller's list during a seek()
+    int m_current = -1;
+};
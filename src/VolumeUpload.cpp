@@ -0,0 +1,284 @@
+#include "VolumeUpload.h"
+
+#include <algorithm>
+
+VolumeUploader::VolumeUploader(int ringSize)
+    : m_ringSize(std::max(ringSize, 1)), m_fences(m_ringSize, nullptr)
+{
+    m_persistent = GLEW_ARB_buffer_storage != 0;
+}
+
+VolumeUploader::~VolumeUploader()
+{
+    if (m_texture != 0)
+    {
+        glDeleteTextures(1, &m_texture);
+    }
+    release();
+}
+
+void VolumeUploader::release()
+{
+    for (GLsync& fence : m_fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (m_buffer != 0)
+    {
+        if (m_mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+    m_mapped = nullptr;
+    m_slotBytes = 0;
+}
+
+// Makes every ring slot at least slotBytes long, reallocating the ring if it is too small
+void VolumeUploader::reserve(size_t slotBytes)
+{
+    if (slotBytes <= m_slotBytes)
+    {
+        return;
+    }
+    release();
+
+    m_slotBytes = slotBytes;
+    GLsizeiptr total = GLsizeiptr(m_slotBytes * m_ringSize);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    if (m_persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, nullptr, flags);
+        m_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags));
+        if (!m_mapped)
+        {
+            // Immutable storage can't be respecified, start over with a buffer mapped per slot
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &m_buffer);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+            m_persistent = false;
+        }
+    }
+    if (!m_persistent)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void VolumeUploader::begin(std::shared_ptr<const BrickMap> volume, float border)
+{
+    if (m_texture != 0)
+    {
+        glDeleteTextures(1, &m_texture);
+    }
+    m_finished = nullptr;
+
+    int gridSize = volume->resolution();
+    reserve((size_t)gridSize * gridSize * BRICK_SIZE * sizeof(float));
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    float border_color[4] = { border, border, border, border };
+    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, border_color);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, gridSize, gridSize, gridSize, 0, GL_RED, GL_FLOAT, nullptr);
+
+    m_volume = std::move(volume);
+    m_nextZ = 0;
+}
+
+bool VolumeUploader::pump(int maxSlabs)
+{
+    if (!m_volume)
+    {
+        return false;
+    }
+
+    int gridSize = m_volume->resolution();
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (int slab = 0; slab < maxSlabs && m_nextZ < gridSize; ++slab)
+    {
+        // The GPU may still be copying out of this slot, come back next frame rather than wait
+        GLsync& fence = m_fences[m_nextSlot];
+        if (fence)
+        {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                break;
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        int depth = std::min(BRICK_SIZE, gridSize - m_nextZ);
+        size_t offset = (size_t)m_nextSlot * m_slotBytes;
+        size_t bytes = (size_t)gridSize * gridSize * depth * sizeof(float);
+        if (m_persistent)
+        {
+            m_volume->readSlab(m_nextZ, depth, reinterpret_cast<float*>(m_mapped + offset));
+        }
+        else
+        {
+            // The fence above already guarantees the slot is idle, so no implicit sync is needed
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, GLintptr(offset), GLsizeiptr(bytes), flags);
+            if (!mapped)
+            {
+                // Nothing was written, the same slab gets another try next frame
+                break;
+            }
+            m_volume->readSlab(m_nextZ, depth, static_cast<float*>(mapped));
+            if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            {
+                // The buffer's contents were lost while it was mapped
+                break;
+            }
+        }
+
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, m_nextZ, gridSize, gridSize, depth, GL_RED, GL_FLOAT, reinterpret_cast<const void*>(offset));
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_nextSlot = (m_nextSlot + 1) % m_ringSize;
+        m_nextZ += depth;
+    }
+
+    // Every other texture upload reads from client memory
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (m_nextZ < gridSize)
+    {
+        return false;
+    }
+    m_finished = std::move(m_volume);
+    return true;
+}
+
+// glTexSubImage3D of count packed bricks starting at bricks[first], from data in the bound
+// unpack buffer or in client memory when none is bound
+static void upload_bricks(const BrickMap& volume, const std::vector<size_t>& bricks, size_t first, size_t count, const float* data)
+{
+    int gridSize = volume.resolution();
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Bricks on the far faces of a volume that isn't a multiple of BRICK_SIZE are cut short
+        glm::ivec3 origin = volume.brickCoord(bricks[first + i]) * BRICK_SIZE;
+        glm::ivec3 size = glm::min(glm::ivec3(BRICK_SIZE), glm::ivec3(gridSize) - origin);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, origin.x, origin.y, origin.z, size.x, size.y, size.z, GL_RED, GL_FLOAT,
+                        data + i * BRICK_VOXELS);
+    }
+}
+
+void VolumeUploader::patch(GLuint texture, const BrickMap& volume, const std::vector<size_t>& bricks)
+{
+    if (bricks.empty())
+    {
+        return;
+    }
+
+    int gridSize = volume.resolution();
+    reserve((size_t)gridSize * gridSize * BRICK_SIZE * sizeof(float));
+    size_t brick_bytes = BRICK_VOXELS * sizeof(float);
+    size_t per_slot = m_slotBytes / brick_bytes;
+
+    // Bricks are packed back to back in their own x-fastest 8^3 layout
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, BRICK_SIZE);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, BRICK_SIZE);
+
+    for (size_t first = 0; first < bricks.size(); first += per_slot)
+    {
+        size_t count = std::min(per_slot, bricks.size() - first);
+        GLsync& fence = m_fences[m_nextSlot];
+        if (fence)
+        {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        size_t offset = (size_t)m_nextSlot * m_slotBytes;
+        float* mapped;
+        if (m_persistent)
+        {
+            mapped = reinterpret_cast<float*>(m_mapped + offset);
+        }
+        else
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            mapped = static_cast<float*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, GLintptr(offset), GLsizeiptr(count * brick_bytes), flags));
+        }
+        if (mapped)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                volume.readBrick(bricks[first + i], mapped + i * BRICK_VOXELS);
+            }
+        }
+        if (!mapped || (!m_persistent && !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)))
+        {
+            // A patch can't wait for the next frame, so these bricks go up from client memory instead
+            std::vector<float> voxels(count * BRICK_VOXELS);
+            for (size_t i = 0; i < count; ++i)
+            {
+                volume.readBrick(bricks[first + i], voxels.data() + i * BRICK_VOXELS);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            upload_bricks(volume, bricks, first, count, voxels.data());
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+            continue;
+        }
+
+        upload_bricks(volume, bricks, first, count, reinterpret_cast<const float*>(offset));
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_nextSlot = (m_nextSlot + 1) % m_ringSize;
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void VolumeUploader::cancel()
+{
+    if (busy())
+    {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+        m_volume = nullptr;
+    }
+}
+
+GLuint VolumeUploader::takeTexture()
+{
+    if (busy())
+    {
+        return 0;
+    }
+    GLuint texture = m_texture;
+    m_texture = 0;
+    return texture;
+}
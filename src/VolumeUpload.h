@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BrickMap.h"
+
+#include <GL/glew.h>
+
+#include <memory>
+#include <vector>
+
+// Streams a BrickMap into a new R32F 3D texture through a ring of pixel buffer objects, a few
+// brick-deep z-slabs per pump(), so an upload never stalls a frame and the dense volume never
+// exists in host memory. Slabs are expanded straight into the mapped buffers, which stay mapped
+// for the uploader's lifetime where GL 4.4 buffer storage is available. A fence per ring slot
+// keeps a slab from being overwritten before the GPU has copied it into the texture.
+// Needs a current GL context for its whole lifetime.
+class VolumeUploader
+{
+public:
+    explicit VolumeUploader(int ringSize = 3);
+    ~VolumeUploader();
+
+    VolumeUploader(const VolumeUploader&) = delete;
+    VolumeUploader& operator=(const VolumeUploader&) = delete;
+
+    // Starts streaming volume into a new texture whose lookups outside the volume return border.
+    // An upload still in progress is abandoned and its texture deleted.
+    void begin(std::shared_ptr<const BrickMap> volume, float border);
+
+    // Submits up to maxSlabs more slabs, fewer if the GPU still holds every ring slot.
+    // Returns true once the last slab of the volume has been submitted.
+    bool pump(int maxSlabs);
+
+    bool busy() const { return m_volume != nullptr; }
+
+    // Abandons an upload in progress and deletes its texture
+    void cancel();
+
+    // Copies bricks of volume into texture, which already holds the rest of it, through the same
+    // ring of buffers. Unlike pump() this waits for ring slots the GPU still holds, since the
+    // caller wants the new bricks on screen this frame.
+    void patch(GLuint texture, const BrickMap& volume, const std::vector<size_t>& bricks);
+
+    // The finished texture (0 while an upload is in progress) and the volume it holds.
+    // The caller owns the texture from now on.
+    GLuint takeTexture();
+    std::shared_ptr<const BrickMap> volume() const { return m_finished; }
+
+private:
+    void reserve(size_t slotBytes);
+    void release();
+
+    int m_ringSize;
+    bool m_persistent = false;
+    GLuint m_buffer = 0;
+    size_t m_slotBytes = 0;
+    uint8_t* m_mapped = nullptr;        // whole ring, persistent mapping only
+    std::vector<GLsync> m_fences;
+    int m_nextSlot = 0;
+
+    std::shared_ptr<const BrickMap> m_volume;
+    std::shared_ptr<const BrickMap> m_finished;
+    GLuint m_texture = 0;
+    int m_nextZ = 0;
+};
@@ -0,0 +1,841 @@
+#include "VoxelBaker.h"
+
+#include "FractalInterval.h"
+#include "FractalSimd.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+glm::vec3 VoxelCenter(const BakeSettings& settings, int x, int y, int z)
+{
+    glm::vec3 voxel_size = (settings.bounds_max - settings.bounds_min) / float(settings.resolution);
+    return settings.bounds_min + (glm::vec3(x, y, z) + 0.5f) * voxel_size;
+}
+
+// Fractal space distance to volume units, clamped to the band
+static void to_volume_distance(const BakeSettings& settings, float* values, size_t count)
+{
+    glm::vec3 extent = settings.bounds_max - settings.bounds_min;
+    float scale = 1.0f / std::min(std::min(extent.x, extent.y), extent.z);
+    for (size_t i = 0; i < count; ++i)
+    {
+        values[i] = std::min(values[i] * scale, settings.distance_band);
+    }
+}
+
+// Evaluates field (a BakeField) at count points given as SoA coordinates, distances in fractal space
+static void evaluate_points(const BakeSettings& settings, int field, const float* xs, const float* ys, const float* zs, size_t count, float* out)
+{
+    bool distance = field == BAKE_DISTANCE;
+    if (!settings.simd)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 p(xs[i], ys[i], zs[i]);
+            out[i] = distance ? FractalDistance(settings.fractal, p) : FractalDensity(settings.fractal, p);
+        }
+    }
+    else
+    {
+        PointBatch batch;
+        batch.x = xs;
+        batch.y = ys;
+        batch.z = zs;
+        batch.count = count;
+        if (distance)
+        {
+            FractalDistanceBatch(settings.fractal, batch, out);
+        }
+        else
+        {
+            FractalDensityBatch(settings.fractal, batch, out);
+        }
+    }
+}
+
+// Voxel values of settings.field at count points
+static void evaluate_voxels(const BakeSettings& settings, const float* xs, const float* ys, const float* zs, size_t count, float* out)
+{
+    evaluate_points(settings, settings.field, xs, ys, zs, count, out);
+    if (settings.field == BAKE_DISTANCE)
+    {
+        to_volume_distance(settings, out, count);
+    }
+}
+
+// Fills block with the voxels of every brick in bricks, one BRICK_VOXELS run per brick, x fastest
+static void evaluate_bricks(const BakeSettings& settings, const BrickMap& volume, const std::vector<size_t>& bricks, std::vector<float>& block)
+{
+    size_t count = bricks.size() * BRICK_VOXELS;
+    block.resize(count);
+
+    // Gather all the bricks into one SoA batch so the SIMD lanes can refill across them
+    thread_local std::vector<float> xs, ys, zs;
+    xs.resize(count);
+    ys.resize(count);
+    zs.resize(count);
+
+    size_t i = 0;
+    for (size_t brick : bricks)
+    {
+        glm::ivec3 origin = volume.brickCoord(brick) * BRICK_SIZE;
+        for (int z = 0; z < BRICK_SIZE; ++z)
+        {
+            for (int y = 0; y < BRICK_SIZE; ++y)
+            {
+                for (int x = 0; x < BRICK_SIZE; ++x, ++i)
+                {
+                    glm::vec3 p = VoxelCenter(settings, origin.x + x, origin.y + y, origin.z + z);
+                    xs[i] = p.x;
+                    ys[i] = p.y;
+                    zs[i] = p.z;
+                }
+            }
+        }
+    }
+
+    evaluate_voxels(settings, xs.data(), ys.data(), zs.data(), count, block.data());
+}
+
+// Box of a subdivided block, corners inclusive, so neighbouring boxes share their faces
+struct SubdivideBox
+{
+    glm::ivec3 lo, hi;
+};
+
+// Smallest job a subdivided or carved bake starts from, in bricks
+const int STRATEGY_BLOCK_BRICKS = 8;
+
+// Boxes with an edge this short have their insides evaluated instead of being split again
+const int SUBDIVIDE_MIN_EDGE = 4;
+
+// Voxel states of a subdivided block
+const uint8_t VOXEL_PENDING = 0;
+const uint8_t VOXEL_EVALUATED = 1;     // evaluated or queued to be
+const uint8_t VOXEL_FILLED = 2;
+
+// Calls f(x, y, z) for every voxel on the faces of box
+template<class F>
+static void for_box_faces(const SubdivideBox& box, F f)
+{
+    for (int z = box.lo.z; z <= box.hi.z; ++z)
+    {
+        for (int y = box.lo.y; y <= box.hi.y; ++y)
+        {
+            if (z == box.lo.z || z == box.hi.z || y == box.lo.y || y == box.hi.y)
+            {
+                for (int x = box.lo.x; x <= box.hi.x; ++x)
+                {
+                    f(x, y, z);
+                }
+            }
+            else
+            {
+                f(box.lo.x, y, z);
+                f(box.hi.x, y, z);
+            }
+        }
+    }
+}
+
+// Whether every voxel on the faces of box in values, a size block, holds value
+static bool box_faces_equal(const SubdivideBox& box, const float* values, glm::ivec3 size, float value)
+{
+    for (int z = box.lo.z; z <= box.hi.z; ++z)
+    {
+        for (int y = box.lo.y; y <= box.hi.y; ++y)
+        {
+            const float* row = values + (size_t)size.x * (y + (size_t)size.y * z);
+            if (z == box.lo.z || z == box.hi.z || y == box.lo.y || y == box.hi.y)
+            {
+                for (int x = box.lo.x; x <= box.hi.x; ++x)
+                {
+                    if (row[x] != value)
+                    {
+                        return false;
+                    }
+                }
+            }
+            else if (row[box.lo.x] != value || row[box.hi.x] != value)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Calls f(x, y, z) for every voxel strictly inside box on one of the planes through mid, the
+// faces its eight children add
+template<class F>
+static void for_box_middle(const SubdivideBox& box, glm::ivec3 mid, F f)
+{
+    for (int z = box.lo.z + 1; z < box.hi.z; ++z)
+    {
+        for (int y = box.lo.y + 1; y < box.hi.y; ++y)
+        {
+            if (z == mid.z || y == mid.y)
+            {
+                for (int x = box.lo.x + 1; x < box.hi.x; ++x)
+                {
+                    f(x, y, z);
+                }
+            }
+            else
+            {
+                f(mid.x, y, z);
+            }
+        }
+    }
+}
+
+// Calls f(x, y, z) for every voxel strictly inside box
+template<class F>
+static void for_box_inside(const SubdivideBox& box, F f)
+{
+    for (int z = box.lo.z + 1; z < box.hi.z; ++z)
+    {
+        for (int y = box.lo.y + 1; y < box.hi.y; ++y)
+        {
+            for (int x = box.lo.x + 1; x < box.hi.x; ++x)
+            {
+                f(x, y, z);
+            }
+        }
+    }
+}
+
+// Fills values (x fastest) with the size voxels starting at voxel origin, Mariani-Silver style:
+// only the faces of a box are evaluated, and if they all hold the same value so does its inside.
+// Boxes with mixed faces are split into eight that share the middle planes. Every box of a level
+// is evaluated as one batch. states gets the VOXEL_* state each voxel ended up in.
+static void subdivide_block(const BakeSettings& settings, glm::ivec3 origin, glm::ivec3 size, std::vector<float>& values, std::vector<uint8_t>& states)
+{
+    size_t count = (size_t)size.x * size.y * size.z;
+    values.resize(count);
+    states.assign(count, VOXEL_PENDING);
+
+    // Voxel centers along each axis, and the voxels to evaluate next as index and packed coordinates
+    thread_local std::vector<float> centers[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        centers[axis].resize(size[axis]);
+        for (int i = 0; i < size[axis]; ++i)
+        {
+            glm::ivec3 v = origin;
+            v[axis] += i;
+            centers[axis][i] = VoxelCenter(settings, v.x, v.y, v.z)[axis];
+        }
+    }
+    thread_local std::vector<uint32_t> queue, coords;
+    thread_local std::vector<float> xs, ys, zs, results;
+    queue.clear();
+    coords.clear();
+
+    auto index = [&size](int x, int y, int z) { return uint32_t(x + size.x * (y + size.y * z)); };
+    auto enqueue = [&](int x, int y, int z)
+    {
+        uint32_t i = index(x, y, z);
+        if (states[i] == VOXEL_PENDING)
+        {
+            states[i] = VOXEL_EVALUATED;
+            queue.push_back(i);
+            coords.push_back(uint32_t(x) | uint32_t(y) << 10 | uint32_t(z) << 20);
+        }
+    };
+
+    std::vector<SubdivideBox> boxes = { { glm::ivec3(0), size - 1 } };
+    std::vector<SubdivideBox> next;
+    for_box_faces(boxes[0], enqueue);
+    while (!queue.empty())
+    {
+        size_t n = queue.size();
+        xs.resize(n);
+        ys.resize(n);
+        zs.resize(n);
+        results.resize(n);
+        for (size_t k = 0; k < n; ++k)
+        {
+            xs[k] = centers[0][coords[k] & 1023];
+            ys[k] = centers[1][coords[k] >> 10 & 1023];
+            zs[k] = centers[2][coords[k] >> 20];
+        }
+        evaluate_voxels(settings, xs.data(), ys.data(), zs.data(), n, results.data());
+        for (size_t k = 0; k < n; ++k)
+        {
+            values[queue[k]] = results[k];
+        }
+        queue.clear();
+        coords.clear();
+
+        next.clear();
+        for (const SubdivideBox& box : boxes)
+        {
+            float first = values[index(box.lo.x, box.lo.y, box.lo.z)];
+            glm::ivec3 edge = box.hi - box.lo;
+            if (box_faces_equal(box, values.data(), size, first))
+            {
+                for_box_inside(box, [&](int x, int y, int z)
+                {
+                    uint32_t i = index(x, y, z);
+                    values[i] = first;
+                    states[i] = VOXEL_FILLED;
+                });
+            }
+            else if (std::min(std::min(edge.x, edge.y), edge.z) <= SUBDIVIDE_MIN_EDGE)
+            {
+                for_box_inside(box, enqueue);
+            }
+            else
+            {
+                glm::ivec3 mid = box.lo + edge / 2;
+                for_box_middle(box, mid, enqueue);
+                for (int c = 0; c < 8; ++c)
+                {
+                    SubdivideBox child;
+                    child.lo = glm::ivec3(c & 1 ? mid.x : box.lo.x, c & 2 ? mid.y : box.lo.y, c & 4 ? mid.z : box.lo.z);
+                    child.hi = glm::ivec3(c & 1 ? box.hi.x : mid.x, c & 2 ? box.hi.y : mid.y, c & 4 ? box.hi.z : mid.z);
+                    next.push_back(child);
+                }
+            }
+        }
+        boxes.swap(next);
+    }
+}
+
+// If seed holds one value over the footprint of brick (a brick of volume) plus one seed voxel
+// around it, returns true and that value
+static bool seeded_value(const BrickMap& seed, const BrickMap& volume, size_t brick, float& value)
+{
+    float scale = float(seed.resolution()) / float(volume.resolution());
+    glm::vec3 origin = glm::vec3(volume.brickCoord(brick) * BRICK_SIZE);
+    glm::ivec3 lo = glm::ivec3(glm::floor(origin * scale)) - 1;
+    glm::ivec3 hi = glm::ivec3(glm::ceil((origin + float(BRICK_SIZE)) * scale)) + 1;
+
+    glm::vec2 range = seed.valueRange(lo, hi);
+    value = range.x;
+    return range.x == range.y;
+}
+
+// Box of a carved block, voxels [lo, hi)
+struct CarveBox
+{
+    glm::ivec3 lo, hi;
+};
+
+// Fraction of a distance estimate trusted to be empty. The estimates are only approximately a
+// lower bound on the distance to the fractal.
+const float CARVE_SAFETY = 0.5f;
+
+// Fills values (x fastest) with the size voxels starting at voxel origin by sphere carving: the
+// distance estimate at the center of a box is the radius of a ball with nothing of the fractal in
+// it, and a box inside that ball is empty, a density of 0 or, where the ball reaches at least the
+// band past it, the clamped distance. Boxes that aren't empty are split in eight, starting from
+// the whole block so the large empty regions go first, and boxes of 2^3 voxels or fewer are
+// evaluated voxel by voxel. states gets the VOXEL_* state each voxel ended up in.
+static void carve_block(const BakeSettings& settings, glm::ivec3 origin, glm::ivec3 size, std::vector<float>& values, std::vector<uint8_t>& states)
+{
+    size_t count = (size_t)size.x * size.y * size.z;
+    values.resize(count);
+    states.assign(count, VOXEL_PENDING);
+
+    bool distance = settings.field == BAKE_DISTANCE;
+    float empty = distance ? settings.distance_band : 0.0f;
+    glm::vec3 extent = settings.bounds_max - settings.bounds_min;
+    float band = distance ? settings.distance_band * std::min(std::min(extent.x, extent.y), extent.z) : 0.0f;
+
+    // Box centers, then the voxels of boxes too small to split
+    thread_local std::vector<float> xs, ys, zs, results, reach;
+    thread_local std::vector<float> voxel_xs, voxel_ys, voxel_zs;
+    thread_local std::vector<uint32_t> queue;
+    auto index = [&size](int x, int y, int z) { return uint32_t(x + size.x * (y + size.y * z)); };
+
+    std::vector<CarveBox> boxes = { { glm::ivec3(0), size } };
+    std::vector<CarveBox> next;
+    while (!boxes.empty())
+    {
+        // Distance estimates at the box centers, and how far they have to reach to cover the box
+        size_t n = boxes.size();
+        xs.resize(n);
+        ys.resize(n);
+        zs.resize(n);
+        reach.resize(n);
+        results.resize(n);
+        for (size_t k = 0; k < n; ++k)
+        {
+            glm::ivec3 lo = origin + boxes[k].lo, hi = origin + boxes[k].hi - 1;
+            glm::vec3 first = VoxelCenter(settings, lo.x, lo.y, lo.z);
+            glm::vec3 last = VoxelCenter(settings, hi.x, hi.y, hi.z);
+            glm::vec3 center = 0.5f * (first + last);
+            xs[k] = center.x;
+            ys[k] = center.y;
+            zs[k] = center.z;
+            reach[k] = glm::length(last - center) + band;
+        }
+        evaluate_points(settings, BAKE_DISTANCE, xs.data(), ys.data(), zs.data(), n, results.data());
+
+        next.clear();
+        queue.clear();
+        voxel_xs.clear();
+        voxel_ys.clear();
+        voxel_zs.clear();
+        for (size_t k = 0; k < n; ++k)
+        {
+            const CarveBox& box = boxes[k];
+            glm::ivec3 edge = box.hi - box.lo;
+            if (results[k] * CARVE_SAFETY > reach[k])
+            {
+                for (int z = box.lo.z; z < box.hi.z; ++z)
+                {
+                    for (int y = box.lo.y; y < box.hi.y; ++y)
+                    {
+                        for (int x = box.lo.x; x < box.hi.x; ++x)
+                        {
+                            uint32_t i = index(x, y, z);
+                            values[i] = empty;
+                            states[i] = VOXEL_FILLED;
+                        }
+                    }
+                }
+            }
+            else if (std::max(std::max(edge.x, edge.y), edge.z) <= 2)
+            {
+                for (int z = box.lo.z; z < box.hi.z; ++z)
+                {
+                    for (int y = box.lo.y; y < box.hi.y; ++y)
+                    {
+                        for (int x = box.lo.x; x < box.hi.x; ++x)
+                        {
+                            glm::vec3 p = VoxelCenter(settings, origin.x + x, origin.y + y, origin.z + z);
+                            voxel_xs.push_back(p.x);
+                            voxel_ys.push_back(p.y);
+                            voxel_zs.push_back(p.z);
+                            queue.push_back(index(x, y, z));
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // Axes of a single voxel aren't split
+                glm::ivec3 mid = box.lo + edge / 2;
+                for (int c = 0; c < 8; ++c)
+                {
+                    CarveBox child;
+                    child.lo = glm::ivec3(c & 1 ? mid.x : box.lo.x, c & 2 ? mid.y : box.lo.y, c & 4 ? mid.z : box.lo.z);
+                    child.hi = glm::ivec3(c & 1 ? box.hi.x : mid.x, c & 2 ? box.hi.y : mid.y, c & 4 ? box.hi.z : mid.z);
+                    if (child.lo.x < child.hi.x && child.lo.y < child.hi.y && child.lo.z < child.hi.z)
+                    {
+                        next.push_back(child);
+                    }
+                }
+            }
+        }
+
+        n = queue.size();
+        results.resize(n);
+        evaluate_voxels(settings, voxel_xs.data(), voxel_ys.data(), voxel_zs.data(), n, results.data());
+        for (size_t k = 0; k < n; ++k)
+        {
+            values[queue[k]] = results[k];
+            states[queue[k]] = VOXEL_EVALUATED;
+        }
+        boxes.swap(next);
+    }
+}
+
+// Copies the bricks of a block baked into block, a size voxel grid starting at brick start, into
+// the volume. Returns how many of their voxels were filled instead of evaluated.
+static size_t store_block(BrickMap& volume, const std::vector<size_t>& bricks, glm::ivec3 start, glm::ivec3 size,
+                          const std::vector<float>& block, const std::vector<uint8_t>& states)
+{
+    float voxels[BRICK_VOXELS];
+    size_t filled = 0;
+    for (size_t brick : bricks)
+    {
+        glm::ivec3 offset = (volume.brickCoord(brick) - start) * BRICK_SIZE;
+        for (int z = 0; z < BRICK_SIZE; ++z)
+        {
+            for (int y = 0; y < BRICK_SIZE; ++y)
+            {
+                size_t row = offset.x + size.x * ((size_t)offset.y + y + (size_t)size.y * (offset.z + z));
+                for (int x = 0; x < BRICK_SIZE; ++x)
+                {
+                    voxels[x + BRICK_SIZE * (y + BRICK_SIZE * z)] = block[row + x];
+                    filled += states[row + x] == VOXEL_FILLED;
+                }
+            }
+        }
+        volume.setBrick(brick, voxels);
+    }
+    return filled;
+}
+
+// If interval arithmetic proves that every voxel of the bricks [start, end) bakes to the same
+// value, returns true and that value
+static bool proven_value(const BakeSettings& settings, glm::ivec3 start, glm::ivec3 end, float& value)
+{
+    bool distance = settings.field == BAKE_DISTANCE;
+    glm::ivec3 last = end * BRICK_SIZE - 1;
+    RegionBound bound = BoundFractalRegion(settings.fractal, VoxelCenter(settings, start.x * BRICK_SIZE, start.y * BRICK_SIZE, start.z * BRICK_SIZE),
+                                           VoxelCenter(settings, last.x, last.y, last.z), distance);
+    if (bound.kind == REGION_INSIDE)
+    {
+        value = distance ? 0.0f : 1.0f;
+        return true;
+    }
+    if (bound.kind != REGION_ESCAPES)
+    {
+        return false;
+    }
+    if (!distance)
+    {
+        value = float(bound.escape_iteration) / float(settings.fractal.max_iterations);
+        return true;
+    }
+
+    // Escaped distances are only the same where they are all clamped to the band
+    glm::vec3 extent = settings.bounds_max - settings.bounds_min;
+    float scale = 1.0f / std::min(std::min(extent.x, extent.y), extent.z);
+    value = settings.distance_band;
+    return bound.min_distance * scale >= settings.distance_band * 1.001f;
+}
+
+// Whether settings asks for a subdivided bake, which only density bakes do
+static bool subdivides(const BakeSettings& settings)
+{
+    return settings.strategy == BAKE_SUBDIVIDE && settings.field == BAKE_DENSITY;
+}
+
+// Where a brick that isn't evaluated is copied from: voxel v of the brick has the value of voxel
+// symmetry(v) of source
+struct BrickSource
+{
+    uint32_t source = NO_SOURCE;
+    uint8_t symmetry = 0;
+
+    static const uint32_t NO_SOURCE = 0xffffffffu;
+};
+
+// Symmetries of the fractal that map every voxel center of the volume onto another voxel center,
+// and every brick onto another brick. Empty if there are none besides the identity.
+static std::vector<AxisSymmetry> grid_symmetries(const BakeSettings& settings)
+{
+    std::vector<AxisSymmetry> symmetries;
+    if (!settings.symmetry || settings.resolution % BRICK_SIZE != 0)
+    {
+        return symmetries;
+    }
+
+    // Axis i takes the coordinates of axis[i], so its range has to be the same, or mirrored for a negated axis
+    for (const AxisSymmetry& g : FractalSymmetries(settings.fractal))
+    {
+        bool fits = true;
+        for (int i = 0; i < 3; ++i)
+        {
+            int from = g.axis[i];
+            fits = fits && (g.sign[i] > 0
+                ? settings.bounds_min[from] == settings.bounds_min[i] && settings.bounds_max[from] == settings.bounds_max[i]
+                : settings.bounds_min[from] == -settings.bounds_max[i] && settings.bounds_max[from] == -settings.bounds_min[i]);
+        }
+        if (fits)
+        {
+            symmetries.push_back(g);
+        }
+    }
+    if (symmetries.size() == 1)
+    {
+        symmetries.clear();
+    }
+    return symmetries;
+}
+
+// Image of cell index c of a size^3 grid, with mirrored axes counted from the far side
+static glm::ivec3 map_cell(const AxisSymmetry& g, glm::ivec3 c, int size)
+{
+    glm::ivec3 mapped;
+    for (int i = 0; i < 3; ++i)
+    {
+        mapped[i] = g.sign[i] > 0 ? c[g.axis[i]] : size - 1 - c[g.axis[i]];
+    }
+    return mapped;
+}
+
+// Picks the lowest numbered brick of every orbit in layers [first, end) to be evaluated and points
+// the rest of the orbit at it. Orbits reaching outside the layers are only shared within them.
+static std::vector<BrickSource> brick_sources(const BrickMap& volume, const std::vector<AxisSymmetry>& symmetries, int first, int end)
+{
+    std::vector<BrickSource> sources(volume.brickCount());
+    int bricks = volume.bricksPerSide();
+    for (size_t brick = (size_t)first * bricks * bricks; brick < (size_t)end * bricks * bricks; ++brick)
+    {
+        glm::ivec3 coord = volume.brickCoord(brick);
+        for (size_t g = 1; g < symmetries.size(); ++g)
+        {
+            glm::ivec3 image = map_cell(symmetries[g], coord, bricks);
+            size_t other = volume.brickIndex(image.x, image.y, image.z);
+            uint32_t current = sources[brick].source == BrickSource::NO_SOURCE ? uint32_t(brick) : sources[brick].source;
+            if (image.z >= first && image.z < end && other < current)
+            {
+                sources[brick].source = uint32_t(other);
+                sources[brick].symmetry = uint8_t(g);
+            }
+        }
+    }
+    return sources;
+}
+
+// For every symmetry, the voxel inside the source brick each voxel of a brick is copied from
+static std::vector<uint16_t> voxel_maps(const std::vector<AxisSymmetry>& symmetries)
+{
+    std::vector<uint16_t> maps(symmetries.size() * BRICK_VOXELS);
+    for (size_t g = 0; g < symmetries.size(); ++g)
+    {
+        for (int i = 0; i < BRICK_VOXELS; ++i)
+        {
+            glm::ivec3 v = map_cell(symmetries[g], glm::ivec3(i % BRICK_SIZE, (i / BRICK_SIZE) % BRICK_SIZE, i / (BRICK_SIZE * BRICK_SIZE)), BRICK_SIZE);
+            maps[g * BRICK_VOXELS + i] = uint16_t(v.x + BRICK_SIZE * (v.y + BRICK_SIZE * v.z));
+        }
+    }
+    return maps;
+}
+
+// Fills brick from the brick it is a mirror image of, map being its symmetry's voxel map
+static void mirror_brick(BrickMap& volume, size_t brick, const BrickSource& from, const uint16_t* map)
+{
+    if (volume.isConstant(from.source))
+    {
+        volume.setConstant(brick, volume.constantValue(from.source));
+        return;
+    }
+
+    const float* source = volume.brickData(from.source);
+    float voxels[BRICK_VOXELS];
+    for (int i = 0; i < BRICK_VOXELS; ++i)
+    {
+        voxels[i] = source[map[i]];
+    }
+    volume.setBrick(brick, voxels);
+}
+
+// Bakes the bricks in [start, end) (in bricks) and stores them in the volume.
+// Bricks with a source in sources are left for mirror_brick().
+static void bake_block(const BakeSettings& settings, BrickMap& volume, const BrickMap* seed, const std::vector<BrickSource>& sources,
+                       glm::ivec3 start, glm::ivec3 end, std::atomic<size_t>& seeded, std::atomic<size_t>& filled, std::atomic<size_t>& proven)
+{
+    if (settings.cancel && *settings.cancel)
+    {
+        return;
+    }
+
+    thread_local std::vector<size_t> bricks;
+    thread_local std::vector<float> block;
+    bricks.clear();
+
+    // Try the whole block before its bricks, far from the surface one proof covers all of them
+    float block_value;
+    bool block_proven = settings.intervals && proven_value(settings, start, end, block_value);
+
+    for (int bz = start.z; bz < end.z; ++bz)
+    {
+        for (int by = start.y; by < end.y; ++by)
+        {
+            for (int bx = start.x; bx < end.x; ++bx)
+            {
+                size_t brick = volume.brickIndex(bx, by, bz);
+                float value;
+                if (!sources.empty() && sources[brick].source != BrickSource::NO_SOURCE)
+                {
+                    continue;
+                }
+                if (block_proven)
+                {
+                    volume.setConstant(brick, block_value);
+                    proven++;
+                }
+                else if (settings.intervals && proven_value(settings, glm::ivec3(bx, by, bz), glm::ivec3(bx + 1, by + 1, bz + 1), value))
+                {
+                    volume.setConstant(brick, value);
+                    proven++;
+                }
+                else if (seed && seeded_value(*seed, volume, brick, value))
+                {
+                    volume.setConstant(brick, value);
+                    seeded++;
+                }
+                else
+                {
+                    bricks.push_back(brick);
+                }
+            }
+        }
+    }
+    if (bricks.empty())
+    {
+        return;
+    }
+
+    if (subdivides(settings) || settings.strategy == BAKE_CARVE)
+    {
+        // The whole block is subdivided or carved, but only the bricks that need baking are stored
+        thread_local std::vector<uint8_t> states;
+        glm::ivec3 size = (end - start) * BRICK_SIZE;
+        if (settings.strategy == BAKE_CARVE)
+        {
+            carve_block(settings, start * BRICK_SIZE, size, block, states);
+        }
+        else
+        {
+            subdivide_block(settings, start * BRICK_SIZE, size, block, states);
+        }
+        filled += store_block(volume, bricks, start, size, block, states);
+        return;
+    }
+
+    evaluate_bricks(settings, volume, bricks, block);
+    for (size_t i = 0; i < bricks.size(); ++i)
+    {
+        volume.setBrick(bricks[i], block.data() + i * BRICK_VOXELS);
+    }
+}
+
+void BakeVolume(const BakeSettings& settings, BrickMap& volume, BakeStats* stats, const BrickMap* seed)
+{
+    volume = BrickMap(settings.resolution);
+    BakeBrickLayers(settings, volume, 0, volume.bricksPerSide(), stats, seed);
+}
+
+void BakeBrickLayers(const BakeSettings& settings, BrickMap& volume, int first, int end, BakeStats* stats, const BrickMap* seed)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    int bricks = volume.bricksPerSide();
+    int step = std::max(1, settings.brick_size / BRICK_SIZE);
+    if (subdivides(settings) || settings.strategy == BAKE_CARVE)
+    {
+        // Bigger boxes skip more, the faces of a 64^3 block are a tenth of its voxels, and one
+        // distance estimate can carve all of it
+        step = std::max(step, STRATEGY_BLOCK_BRICKS);
+    }
+    std::atomic<size_t> seeded{ 0 };
+    std::atomic<size_t> filled{ 0 };
+    std::atomic<size_t> proven{ 0 };
+
+    std::vector<AxisSymmetry> symmetries = grid_symmetries(settings);
+    std::vector<BrickSource> sources;
+    if (!symmetries.empty())
+    {
+        sources = brick_sources(volume, symmetries, first, end);
+    }
+
+    // One group per z-slab, one job per block of bricks inside it. Every slab starts out on a
+    // single worker; idle workers steal blocks from slabs that turned out to be expensive.
+    std::vector<std::vector<JobSystem::Job>> slabs;
+    for (int z = first; z < end; z += step)
+    {
+        std::vector<JobSystem::Job> blocks;
+        for (int y = 0; y < bricks; y += step)
+        {
+            for (int x = 0; x < bricks; x += step)
+            {
+                glm::ivec3 lo(x, y, z);
+                glm::ivec3 hi = glm::min(lo + step, glm::ivec3(bricks, bricks, end));
+                blocks.push_back([&settings, &volume, seed, &sources, &seeded, &filled, &proven, lo, hi]
+                {
+                    bake_block(settings, volume, seed, sources, lo, hi, seeded, filled, proven);
+                });
+            }
+        }
+        slabs.push_back(std::move(blocks));
+    }
+
+    std::unique_ptr<JobSystem> own_jobs;
+    JobSystem* jobs = settings.jobs;
+    if (!jobs)
+    {
+        own_jobs = std::make_unique<JobSystem>(settings.threads);
+        jobs = own_jobs.get();
+    }
+    jobs->run(slabs);
+
+    // Once every evaluated brick is done, the rest are copied from them a layer per job
+    size_t mirrored = 0;
+    if (!sources.empty() && !(settings.cancel && *settings.cancel))
+    {
+        std::vector<uint16_t> maps = voxel_maps(symmetries);
+        size_t per_layer = (size_t)bricks * bricks;
+        std::vector<std::vector<JobSystem::Job>> layers(end - first);
+        for (int z = first; z < end; ++z)
+        {
+            layers[z - first].push_back([&volume, &sources, &maps, per_layer, z]
+            {
+                for (size_t brick = z * per_layer; brick < (z + 1) * per_layer; ++brick)
+                {
+                    if (sources[brick].source != BrickSource::NO_SOURCE)
+                    {
+                        mirror_brick(volume, brick, sources[brick], maps.data() + sources[brick].symmetry * BRICK_VOXELS);
+                    }
+                }
+            });
+        }
+        jobs->run(layers);
+        mirrored = (size_t)std::count_if(sources.begin(), sources.end(), [](const BrickSource& s) { return s.source != BrickSource::NO_SOURCE; });
+    }
+
+    if (stats)
+    {
+        double n = settings.resolution;
+        double voxels = n * n * (std::min(double(end) * BRICK_SIZE, n) - double(first) * BRICK_SIZE);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        stats->seconds = elapsed.count();
+        stats->voxels_per_second = voxels / std::max(stats->seconds, 1e-9);
+        stats->seeded_bricks = seeded;
+        stats->mirrored_bricks = mirrored;
+        stats->filled_voxels = filled;
+        stats->proven_bricks = proven;
+    }
+}
+
+BakeVerification VerifyBake(const BakeSettings& settings, const BrickMap& volume)
+{
+    BakeSettings reference_settings = settings;
+    reference_settings.strategy = BAKE_EVERY_VOXEL;
+    reference_settings.symmetry = false;
+    reference_settings.intervals = false;
+
+    BrickMap reference;
+    BakeStats stats;
+    BakeVolume(reference_settings, reference, &stats);
+
+    BakeVerification result;
+    result.reference_seconds = stats.seconds;
+    int n = settings.resolution;
+    for (size_t brick = 0; brick < reference.brickCount(); ++brick)
+    {
+        glm::ivec3 origin = reference.brickCoord(brick) * BRICK_SIZE;
+        bool mismatched = false;
+        for (int z = origin.z; z < std::min(origin.z + BRICK_SIZE, n); ++z)
+        {
+            for (int y = origin.y; y < std::min(origin.y + BRICK_SIZE, n); ++y)
+            {
+                for (int x = origin.x; x < std::min(origin.x + BRICK_SIZE, n); ++x)
+                {
+                    float error = std::abs(volume.voxel(x, y, z) - reference.voxel(x, y, z));
+                    result.voxels++;
+                    if (error > 0.0f)
+                    {
+                        result.mismatched_voxels++;
+                        result.max_error = std::max(result.max_error, error);
+                        mismatched = true;
+                    }
+                }
+            }
+        }
+        result.mismatched_bricks += mismatched;
+    }
+    return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "BrickMap.h"
+#include "Fractal.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+
+class JobSystem;
+
+// What every voxel stores, same numbering as grid::render_mode and the render_mode uniform
+enum BakeField
+{
+    BAKE_DENSITY = 0,      // FractalDensity(), for the accumulating ray march
+    BAKE_DISTANCE = 1      // FractalDistance(), a distance field for sphere tracing that is 0 inside
+};
+
+// Which voxels a bake evaluates
+enum BakeStrategy
+{
+    BAKE_EVERY_VOXEL = 0,
+    // Mariani-Silver subdivision of the density: evaluate the faces of a box, fill its inside if
+    // they all hold the same value, split it in eight otherwise. Much faster where large solid or
+    // empty regions dominate, but a feature that touches no face of its box is lost, see VerifyBake().
+    // Slower than evaluating every voxel for the Menger sponge, whose boxes rarely have uniform faces.
+    BAKE_SUBDIVIDE = 1,
+    // Sphere carving: the distance estimate at the center of a box is an empty ball around it, and
+    // a box inside its ball is stored as empty (a density of 0, or the distance band) unevaluated.
+    // Boxes start as big as a 64^3 block and are split until they fit, so far-field space costs a
+    // handful of estimates. Exterior densities near the surface become 0 instead of their escape time.
+    BAKE_CARVE = 2
+};
+
+// Bumped whenever a change to the fractal kernels or the bake changes the voxels it produces,
+// so volumes cached by older builds are not reused (see VolumeCacheKey)
+const int BAKE_KERNEL_VERSION = 1;
+
+struct BakeSettings
+{
+    FractalParams fractal;
+    int resolution = 512;
+
+    // Region of fractal space covered by the volume
+    glm::vec3 bounds_min = glm::vec3(-1.5f);
+    glm::vec3 bounds_max = glm::vec3(1.5f);
+
+    int threads = 0;        // 0 = one per hardware thread
+    int brick_size = 16;    // edge length of one scheduled job in voxels, rounded down to whole bricks
+    bool simd = true;       // vectorized kernels from FractalSimd.h instead of the scalar ones
+
+    // Evaluate one brick per orbit of the fractal's symmetries (FractalSymmetries) that map the
+    // voxel grid onto itself, and fill the others by mirroring it. Needs bounds that are mirror
+    // images of themselves and a resolution that is a multiple of BRICK_SIZE, otherwise it does nothing.
+    bool symmetry = true;
+
+    // Skip bricks that interval arithmetic (FractalInterval.h) proves to hold a single value and
+    // store them as constant bricks. The proofs allow for float rounding, so the voxels are the
+    // same as evaluating them.
+    bool intervals = true;
+
+    int field = BAKE_DENSITY;
+    int strategy = BAKE_EVERY_VOXEL;    // distance bakes can't be subdivided
+    // Distances are stored in volume units, where the whole volume is 1 across like its texture
+    // coordinates, and clamped to this band so space far from the surface collapses into constant bricks
+    float distance_band = 0.0625f;
+
+    // Set from another thread to abandon the bake, blocks that haven't started yet are skipped
+    const std::atomic<bool>* cancel = nullptr;
+
+    // Runs the bake on this pool instead of starting threads workers for every call
+    JobSystem* jobs = nullptr;
+};
+
+struct BakeStats
+{
+    double seconds = 0.0;
+    double voxels_per_second = 0.0;
+    size_t seeded_bricks = 0;   // bricks filled from the seed volume without evaluating them
+    size_t mirrored_bricks = 0; // bricks copied from a symmetric brick without evaluating them
+    size_t proven_bricks = 0;   // bricks proven constant by interval arithmetic
+    size_t filled_voxels = 0;   // voxels of evaluated bricks that subdivision or carving filled instead
+};
+
+// How far a bake is from evaluating every voxel
+struct BakeVerification
+{
+    size_t voxels = 0;
+    size_t mismatched_voxels = 0;
+    size_t mismatched_bricks = 0;
+    float max_error = 0.0f;
+    double reference_seconds = 0.0;     // of the bake it was compared against
+};
+
+// Position of the center of voxel (x, y, z) in fractal space
+glm::vec3 VoxelCenter(const BakeSettings& settings, int x, int y, int z);
+
+// Replaces volume with a resolution^3 brick map of settings.field. Runs on every core.
+// A seed is an earlier bake of the same settings at a lower resolution: bricks whose footprint in
+// it (plus one seed voxel on every side) holds a single value are filled with that value instead of
+// being evaluated. Features thinner than a seed voxel that fall entirely inside such a region are lost.
+void BakeVolume(const BakeSettings& settings, BrickMap& volume, BakeStats* stats = nullptr, const BrickMap* seed = nullptr);
+
+// Bakes only the brick layers bz in [first, end) of volume, an existing settings.resolution^3 brick map,
+// and leaves the other bricks alone. For volumes that are baked and written out a few layers at a time.
+void BakeBrickLayers(const BakeSettings& settings, BrickMap& volume, int first, int end, BakeStats* stats = nullptr, const BrickMap* seed = nullptr);
+
+// Bakes settings again evaluating every voxel, without symmetry or intervals, and compares volume, a bake of
+// settings, against it voxel by voxel. Needs memory for a second volume.
+BakeVerification VerifyBake(const BakeSettings& settings, const BrickMap& volume);
@@ -17,10 +17,26 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 #include "DebugCallback.h"
+#include "FrameUniforms.h"
 #include "InitShader.h"    // Functions for loading shaders from text files
 #include "Camera.h"
+#include "BrickMap.h"
+#include "GpuBaker.h"
+#include "MinMaxPyramid.h"
+#include "ProgressiveBake.h"
+#include "VolumeUpload.h"
+#include "VolumeCache.h"
+#include "VolumeMemory.h"
+#include "VolumeSequence.h"
+#include "VoxelBaker.h"
+#include "FractalSimd.h"
+#include "Triplex.h"
 
 #include <chrono>
 
@@ -50,6 +66,49 @@ namespace scene
     GLuint shader = -1;
     GLuint textureID = -1;
 
+    // Per-frame uniform block of the fragment shader and what was last uploaded to it. The buffer
+    // is only written when the frame's values differ, which they don't while the camera rests.
+    GLuint frame_ubo = -1;
+    FrameUniforms frame_uniforms;
+    bool frame_uniforms_uploaded = false;
+
+    GLuint rangeTextureID = -1;
+    int range_levels = 0;
+    // Range pyramid of the volume on screen, and of the one being uploaded to replace it
+    std::shared_ptr<MinMaxPyramid> range_pyramid;
+    std::shared_ptr<MinMaxPyramid> upload_pyramid;
+    float range_cell_size = 0.f;
+    float volume_border = 0.f;
+    glm::vec3 bound_center = glm::vec3(0.5f);  // sphere around the fractal in texture coordinates, radius 0 for none
+    float bound_radius = 0.f;
+    glm::vec3 fractal_min = glm::vec3(-1.5f);         // fractal space corner and size of texture coordinates [0, 1]
+    glm::vec3 fractal_extent = glm::vec3(3.f);
+    int volume_resolution = 0;
+
+    // Baked volumes by settings, so switching back to earlier settings doesn't rebake.
+    // Declared before volume_bake, which uses it until it is destroyed.
+    std::unique_ptr<VolumeCache> volume_cache;
+
+    // Background bake feeding update_voxels(), reset once it has published its last level
+    std::unique_ptr<ProgressiveBake> volume_bake;
+
+    // Streams each level into a texture over several frames while the old one stays on screen
+    std::unique_ptr<VolumeUploader> volume_upload;
+    const int upload_slabs_per_frame = 4;
+
+    // Bakes straight into the volume textures instead when grid::bake_on_gpu is set
+    std::unique_ptr<GpuBaker> gpu_bake;
+    const int gpu_bake_layers_per_frame = 8;
+    double gpu_bake_start = 0.0;
+
+    // Order sweep baked by FractalBake --sequence, played back by patching only the bricks that
+    // change from frame to frame into the volume texture. No bake runs while it is open.
+    const std::string sequence_path = "../cache/sequence.fbzs";
+    std::unique_ptr<VolumeSequence> volume_sequence;
+    bool sequence_playing = false;
+    float sequence_fps = 24.f;
+    double sequence_frame_time = 0.0;
+
     int color_palette = 0;
 
     glm::vec3 color1 = glm::vec3(0.0, 0.0, 1.0); // Blue
@@ -94,34 +153,11 @@ namespace grid
     float step_size = 0.05;
 
     int fractal_type = 0;
-}
-
-int MandelbulbIteration(glm::vec3 point, float order, int maxIterations) {
-    glm::vec3 z = point;
-    float dr = 1.0;
-    float r = 0.0;
-    int i = 0;
-    for (i = 0; i < maxIterations; i++) {
-        r = glm::length(z);
-        if (r > 2.0)
-        {
-            //std::cout << i << std::endl;
-            break; // Escape condition
-        }
-        // Convert to polar coordinates
-        float theta = acos(z.z / r);
-        float phi = atan2(z.y, z.x);
-        dr = pow(r, order - 1.0) * order * dr + 1.0;
-
-        // Scale and rotate the point
-        float zr = pow(r, order);
-        theta *= order;
-        phi *= order;
 
-        // Convert back to Cartesian coordinates
-        z = glm::vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta)) * zr + point;
-    }
-    return i;
+    int render_mode = BAKE_DENSITY;   // what the volume holds and how the fragment shader renders it, or RENDER_DIRECT_DISTANCE
+    int volume_size = 512;            // resolution of the final baked volume
+    int bake_strategy = BAKE_EVERY_VOXEL;
+    bool bake_on_gpu = false;
 }
 
 // Grid of voxels
@@ -156,32 +192,289 @@ void init_grid()
     glVertexAttribPointer(grid::pos_loc, 3, GL_FLOAT, 1, 0, 0);
 }
 
+// Upload the min/max pyramid to a new RG32F 3D texture, pyramid level i becomes mip level i
+GLuint upload_range_pyramid(const MinMaxPyramid& pyramid)
+{
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_3D, textureID);
+    // The marcher only uses texelFetch, so no filtering between cells or levels
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, pyramid.levelCount() - 1);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < pyramid.levelCount(); ++level)
+    {
+        int size = pyramid.levelSize(level);
+        glTexImage3D(GL_TEXTURE_3D, level, GL_RG32F, size, size, size, 0, GL_RG, GL_FLOAT, pyramid.levelData(level));
+    }
+    return textureID;
+}
+
+// Copies the cells MinMaxPyramid::update() recomputed into the range texture, one upload per run
+// of neighbouring cells along x
+void update_range_pyramid(GLuint textureID, const MinMaxPyramid& pyramid, const std::vector<std::vector<size_t>>& cells)
+{
+    glBindTexture(GL_TEXTURE_3D, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < pyramid.levelCount(); ++level)
+    {
+        size_t size = (size_t)pyramid.levelSize(level);
+        const std::vector<size_t>& changed = cells[level];
+        for (size_t i = 0; i < changed.size();)
+        {
+            // The cells are sorted, a run goes on while the next one is the next in the same row
+            size_t first = changed[i++];
+            size_t end = first + 1;
+            while (i < changed.size() && changed[i] == end && end % size != 0)
+            {
+                ++end;
+                ++i;
+            }
+            GLint x = GLint(first % size), y = GLint((first / size) % size), z = GLint(first / (size * size));
+            glTexSubImage3D(GL_TEXTURE_3D, level, x, y, z, GLsizei(end - first), 1, 1, GL_RG, GL_FLOAT, pyramid.levelData(level) + first);
+        }
+    }
+}
+
+// Maps the fractal's bounding sphere into the texture coordinates of a volume baked with settings,
+// so the fragment shader can clip rays to it, and those coordinates back to fractal space
+void set_fractal_bound(const BakeSettings& settings)
+{
+    glm::vec3 extent = settings.bounds_max - settings.bounds_min;
+    scene::fractal_min = settings.bounds_min;
+    scene::fractal_extent = extent;
+    scene::bound_center = -settings.bounds_min / extent;
+    scene::bound_radius = FractalBoundingRadius(settings.fractal) / std::min(std::min(extent.x, extent.y), extent.z);
+}
+
+// Stops any bake or upload and frees the volume, for render modes that don't read one
+void drop_volume()
+{
+    scene::volume_bake.reset();
+    scene::gpu_bake->cancel();
+    scene::volume_upload->cancel();
+    if (scene::textureID != -1)
+    {
+        glDeleteTextures(1, &scene::textureID);
+        glDeleteTextures(1, &scene::rangeTextureID);
+    }
+    scene::textureID = -1;
+    scene::rangeTextureID = -1;
+    scene::range_pyramid.reset();
+    scene::upload_pyramid.reset();
+    scene::range_levels = 0;
+    scene::volume_resolution = 0;
+}
+
+// Starts loading or baking the volume grid::render_mode needs. update_voxels() shows every
+// level of the bake as it comes in, from a quick 64^3 preview up to grid::volume_size^3.
 void init_voxels()
 {
-    int gridSize = 512;
-    std::ifstream inFile("../cache/voxels_512_density.bin", std::ios::binary);
-    std::vector<float> densityData(gridSize * gridSize * gridSize);
-    inFile.read(reinterpret_cast<char*>(densityData.data()), densityData.size() * sizeof(float));
+    int gridSize = grid::volume_size;
+    bool distance = grid::render_mode == BAKE_DISTANCE;
+
+    BakeSettings settings;
+    settings.field = distance ? BAKE_DISTANCE : BAKE_DENSITY;
+    settings.resolution = gridSize;
+    settings.fractal.type = grid::fractal_type;
+    settings.fractal.order = grid::order;
+    settings.fractal.max_iterations = grid::max_iterations;
+    settings.strategy = grid::bake_strategy;
+
+    // Outside the volume there is no density, and the surface is at least the band away
+    scene::volume_border = distance ? settings.distance_band : 0.f;
+    set_fractal_bound(settings);
+
+    if (grid::render_mode == RENDER_DIRECT_DISTANCE)
+    {
+        // Traced from the distance estimate alone, nothing to bake, load or keep in memory
+        drop_volume();
+        return;
+    }
+
+    if (!scene::volume_cache)
+    {
+        // A few 512^3 volumes in memory, a few dozen on disk
+        scene::volume_cache = std::make_unique<VolumeCache>("../cache", size_t(1) << 30, uint64_t(2) << 30);
+    }
 
-    if (!inFile.is_open()) {
-        std::cerr << "Failed to open the file" << std::endl;
+    if (grid::bake_on_gpu && scene::gpu_bake->valid())
+    {
+        // Nothing to cache or upload, the bake stays in its textures
+        std::cout << "Baking " << gridSize << "^3 voxels on the GPU..." << std::endl;
+        scene::volume_bake.reset();
+        scene::volume_upload->cancel();
+        scene::gpu_bake->begin(settings, scene::volume_border);
+        scene::gpu_bake_start = glfwGetTime();
         return;
     }
 
-    glBindAttribLocation(scene::shader, grid::pos_loc, "pos_attrib");
+    std::cout << "Baking " << gridSize << "^3 voxels progressively (" << SimdLevelName(ActiveSimdLevel()) << ")..." << std::endl;
+    scene::gpu_bake->cancel();
+    scene::volume_bake.reset();
+    scene::volume_bake = std::make_unique<ProgressiveBake>(settings, 64, scene::volume_cache.get());
+}
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_3D, textureID);
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+// Swaps in the volume and range textures the GPU bake just finished
+void show_gpu_volume()
+{
+    if (scene::textureID != -1)
+    {
+        glDeleteTextures(1, &scene::textureID);
+        glDeleteTextures(1, &scene::rangeTextureID);
+    }
+    scene::textureID = scene::gpu_bake->takeTexture();
+    scene::rangeTextureID = scene::gpu_bake->takeRangeTexture();
+    scene::range_pyramid.reset();
+    scene::volume_resolution = scene::gpu_bake->settings().resolution;
+    scene::range_levels = scene::gpu_bake->rangeLevels();
+    scene::range_cell_size = float(BRICK_SIZE) / float(scene::volume_resolution);
+    std::cout << "Baked " << scene::volume_resolution << "^3 on the GPU in " << glfwGetTime() - scene::gpu_bake_start << " s" << std::endl;
+}
+
+// Starts streaming the newest level of the background bake to the GPU, and swaps it in for the
+// current volume textures once all of it has arrived
+void update_voxels()
+{
+    if (scene::gpu_bake->busy())
+    {
+        if (scene::gpu_bake->pump(scene::gpu_bake_layers_per_frame))
+        {
+            show_gpu_volume();
+        }
+        return;
+    }
 
+    if (scene::volume_bake)
+    {
+        // Checked before polling, the last level is published before finished() turns true
+        bool finished = scene::volume_bake->finished();
+        BakeStats stats;
+        std::shared_ptr<MinMaxPyramid> pyramid;
+        std::shared_ptr<const BrickMap> volume = scene::volume_bake->poll(&stats, &pyramid);
+        if (volume)
+        {
+            if (stats.seconds > 0.0)
+            {
+                std::cout << "Baked " << volume->resolution() << "^3 in " << stats.seconds << " s (" << stats.voxels_per_second / 1e6
+                          << " Mvoxels/s, " << stats.seeded_bricks << " bricks seeded, " << stats.mirrored_bricks << " mirrored, "
+                          << stats.proven_bricks << " proven, " << stats.filled_voxels << " voxels filled)" << std::endl;
+            }
+            std::cout << volume->denseBrickCount() << " of " << volume->brickCount() << " bricks stored, "
+                      << volume->memoryBytes() / (1024 * 1024) << " MB" << (VolumeMemoryUsesLargePages() ? " on 2 MB pages" : "") << std::endl;
+            scene::volume_upload->begin(volume, scene::volume_border);
+            scene::upload_pyramid = std::move(pyramid);
+        }
+        if (finished)
+        {
+            scene::volume_bake.reset();
+        }
+    }
+
+    if (!scene::volume_upload->busy() || !scene::volume_upload->pump(scene::upload_slabs_per_frame))
+    {
+        return;
+    }
+
+    if (scene::textureID != -1)
+    {
+        glDeleteTextures(1, &scene::textureID);
+        glDeleteTextures(1, &scene::rangeTextureID);
+    }
+    std::shared_ptr<const BrickMap> volume = scene::volume_upload->volume();
+    scene::textureID = scene::volume_upload->takeTexture();
+    scene::volume_resolution = volume->resolution();
+
+    // Lets the ray marcher leap over empty bricks, built next to the volume off the render thread
+    scene::range_pyramid = std::move(scene::upload_pyramid);
+    scene::rangeTextureID = upload_range_pyramid(*scene::range_pyramid);
+    scene::range_levels = scene::range_pyramid->levelCount();
+    scene::range_cell_size = float(BRICK_SIZE) / float(volume->resolution());
+}
+
+// Moves the open sequence to frame and patches the bricks that changed into the volume textures.
+// Does nothing until the first frame has been streamed in whole.
+void show_sequence_frame(int frame)
+{
+    VolumeSequence& sequence = *scene::volume_sequence;
+    if (scene::volume_upload->busy() || scene::textureID == -1 || frame == sequence.currentFrame())
+    {
+        return;
+    }
+
+    std::vector<size_t> changed;
+    if (!sequence.seek(frame, &changed))
+    {
+        std::cerr << "Failed to decode frame " << frame << " of " << scene::sequence_path << std::endl;
+        scene::sequence_playing = false;
+        return;
+    }
+    grid::order = sequence.frameOrder(frame);
+
+    const BrickMap& volume = *sequence.volume();
+    scene::volume_upload->patch(scene::textureID, volume, changed);
+    std::vector<std::vector<size_t>> cells;
+    scene::range_pyramid->update(volume, changed, &cells);
+    update_range_pyramid(scene::rangeTextureID, *scene::range_pyramid, cells);
+}
+
+void reload_shader();
+
+// Opens the sequence at scene::sequence_path in place of the baked volume and starts streaming its first frame
+void open_sequence()
+{
+    auto sequence = std::make_unique<VolumeSequence>();
+    if (!sequence->open(scene::sequence_path) || !sequence->seek(0))
+    {
+        std::cerr << "No volume sequence at " << scene::sequence_path << std::endl;
+        return;
+    }
+    scene::volume_bake.reset();
+    scene::gpu_bake->cancel();
+    scene::volume_sequence = std::move(sequence);
+
+    BakeSettings settings = scene::volume_sequence->settings();
+    grid::render_mode = settings.field;
+    grid::fractal_type = settings.fractal.type;
+    grid::max_iterations = settings.fractal.max_iterations;
+    grid::order = settings.fractal.order;
+    scene::volume_border = settings.field == BAKE_DISTANCE ? settings.distance_band : 0.f;
+    set_fractal_bound(settings);
+
+    // The shader is specialized for the order, like close_sequence() does on the way back
+    reload_shader();
+    scene::volume_upload->begin(scene::volume_sequence->volume(), scene::volume_border);
+    // Built once here, every frame after this one only updates the cells of the bricks it changes
+    scene::upload_pyramid = std::make_shared<MinMaxPyramid>(*scene::volume_sequence->volume());
+    std::cout << "Playing " << scene::volume_sequence->frameCount() << " frames of " << scene::sequence_path << std::endl;
+}
+
+// Goes back to baking, at the order the sequence was left on
+void close_sequence()
+{
+    scene::volume_sequence.reset();
+    scene::sequence_playing = false;
+    reload_shader();
+    init_voxels();
+}
 
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, gridSize, gridSize, gridSize, 0, GL_RED, GL_FLOAT, densityData.data());
+// Steps a playing sequence at scene::sequence_fps
+void update_sequence()
+{
+    if (!scene::volume_sequence || !scene::sequence_playing)
+    {
+        return;
+    }
+    double now = glfwGetTime();
+    if (now - scene::sequence_frame_time < 1.0 / scene::sequence_fps)
+    {
+        return;
+    }
+    scene::sequence_frame_time = now;
+    int next = (scene::volume_sequence->currentFrame() + 1) % scene::volume_sequence->frameCount();
+    show_sequence_frame(next);
 }
 
 void color_palettes(int paletteNum)
@@ -240,6 +533,22 @@ void draw_gui(GLFWwindow* window)
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     ImGui::Text("Camera Position: (%.3f, %.3f, %.3f)", scene::camera.position().x, scene::camera.position().y, scene::camera.position().z);*/
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if (scene::volume_bake)
+    {
+        ImGui::Text("Volume %d^3, baking %d^3...", scene::volume_resolution, scene::volume_bake->currentResolution());
+    }
+    else if (scene::gpu_bake->busy())
+    {
+        ImGui::Text("Volume %d^3, baking %d^3 on the GPU...", scene::volume_resolution, scene::gpu_bake->settings().resolution);
+    }
+    else if (scene::volume_upload->busy())
+    {
+        ImGui::Text("Volume %d^3, uploading...", scene::volume_resolution);
+    }
+    else
+    {
+        ImGui::Text("Volume %d^3", scene::volume_resolution);
+    }
     ImGui::Separator();
     if (ImGui::RadioButton("Color Palette 1", &scene::color_palette, 0)) color_palettes(scene::color_palette);
     if (ImGui::RadioButton("Color Palette 2", &scene::color_palette, 1)) color_palettes(scene::color_palette);
@@ -249,6 +558,57 @@ void draw_gui(GLFWwindow* window)
     ImGui::ColorEdit3("Color 3", glm::value_ptr(scene::color3));
     ImGui::ColorEdit3("Color 4", glm::value_ptr(scene::color4));
     ImGui::ColorEdit3("Color 5", glm::value_ptr(scene::color5));
+    ImGui::Separator();
+    int render_mode = grid::render_mode;
+    ImGui::RadioButton("Density March", &grid::render_mode, BAKE_DENSITY);
+    ImGui::RadioButton("Sphere Trace Distance Field", &grid::render_mode, BAKE_DISTANCE);
+    ImGui::RadioButton("Sphere Trace Distance Estimate (no volume)", &grid::render_mode, RENDER_DIRECT_DISTANCE);
+    bool bakes = !scene::volume_sequence && grid::render_mode != RENDER_DIRECT_DISTANCE;
+    if (bakes && scene::gpu_bake->valid() && ImGui::Checkbox("Bake On GPU", &grid::bake_on_gpu))
+    {
+        init_voxels();
+    }
+    if (bakes && !grid::bake_on_gpu && ImGui::Combo("Bake", &grid::bake_strategy, "Every Voxel\0Subdivision (density)\0Sphere Carving\0"))
+    {
+        init_voxels();
+    }
+    if (grid::render_mode != render_mode)
+    {
+        // A sequence only holds the field it was baked with
+        if (scene::volume_sequence)
+        {
+            close_sequence();
+        }
+        else
+        {
+            init_voxels();
+        }
+    }
+    ImGui::Separator();
+    if (!scene::volume_sequence)
+    {
+        if (ImGui::Button("Open Order Sequence"))
+        {
+            open_sequence();
+        }
+    }
+    else
+    {
+        VolumeSequence& sequence = *scene::volume_sequence;
+        ImGui::Checkbox("Play", &scene::sequence_playing);
+        ImGui::SameLine();
+        ImGui::SliderFloat("FPS", &scene::sequence_fps, 1.0f, 60.0f);
+        float order = grid::order;
+        if (ImGui::SliderFloat("Order", &order, sequence.frameOrder(0), sequence.frameOrder(sequence.frameCount() - 1)))
+        {
+            scene::sequence_playing = false;
+            show_sequence_frame(sequence.nearestFrame(order));
+        }
+        if (ImGui::Button("Close Sequence"))
+        {
+            close_sequence();
+        }
+    }
     //ImGui::RadioButton("Mandelbulb", &grid::fractal_type, 0);
     //ImGui::RadioButton("Mandelbox", &grid::fractal_type, 1);
     //ImGui::RadioButton("Menger Sponge", &grid::fractal_type, 2);
@@ -279,92 +639,62 @@ void display(GLFWwindow* window)
  
     glUseProgram(scene::shader);
  
-    // Get location for shader uniform variable
-    int PVM_loc = glGetUniformLocation(scene::shader, "PVM");
+    // Locations were looked up when the shader was linked
+    const ShaderReflection& reflection = GetShaderReflection(scene::shader);
+    int PVM_loc = reflection.location("PVM");
     if (PVM_loc != -1)
     {
        glm::mat4 PVM = P * V * M;
        glUniformMatrix4fv(PVM_loc, 1, false, glm::value_ptr(PVM));
     }
-    int P_loc = glGetUniformLocation(scene::shader, "P");
-    if (P_loc != -1)
-    {
-        glUniformMatrix4fv(P_loc, 1, false, glm::value_ptr(P));
-    }
-    int V_loc = glGetUniformLocation(scene::shader, "V");
-    if (V_loc != -1)
-    {
-        glUniformMatrix4fv(V_loc, 1, false, glm::value_ptr(V));
-    }
-    int order_loc = glGetUniformLocation(scene::shader, "order");
-    if (order_loc != -1)
-    {
-        glUniform1f(order_loc, grid::order);
-    }
-    int max_iterations_loc = glGetUniformLocation(scene::shader, "max_iterations");
-    if (max_iterations_loc != -1)
-    {
-        glUniform1i(max_iterations_loc, grid::max_iterations);
-    }
-    int point_size_loc = glGetUniformLocation(scene::shader, "point_size");
+    int point_size_loc = reflection.location("point_size");
     if (point_size_loc != -1)
     {
         glUniform1f(point_size_loc, grid::point_size);
     }
-    int fractal_type_loc = glGetUniformLocation(scene::shader, "fractal_type");
-    if (fractal_type_loc != -1)
-    {
-        glUniform1i(fractal_type_loc, grid::fractal_type);
-    }
-    int step_size_loc = glGetUniformLocation(scene::shader, "step_size");
-    if (step_size_loc != -1)
-    {
-        glUniform1f(step_size_loc, grid::step_size);
-    }
-    int width_loc = glGetUniformLocation(scene::shader, "window_width");
-    if (width_loc != -1)
-    {
-        glUniform1i(width_loc, window::size[0]);
-    }
-    int height_loc = glGetUniformLocation(scene::shader, "window_height");
-    if (height_loc != -1)
-    {
-        glUniform1i(height_loc, window::size[1]);
-    }
 
-    int cam_pos_loc = glGetUniformLocation(scene::shader, "cam_pos");
-    if (cam_pos_loc != -1)
+    // The inverses are taken once here instead of in every fragment
+    FrameUniforms frame;
+    frame.inv_P = glm::inverse(P);
+    frame.inv_V = glm::inverse(V);
+    frame.cam_pos = scene::camera.position();
+    frame.order = grid::order;
+    frame.bound_center = scene::bound_center;
+    frame.bound_radius = scene::bound_radius;
+    frame.color1 = scene::color1;
+    frame.range_levels = scene::range_levels;
+    frame.color2 = scene::color2;
+    frame.range_cell_size = scene::range_cell_size;
+    frame.color3 = scene::color3;
+    frame.max_iterations = grid::max_iterations;
+    frame.color4 = scene::color4;
+    frame.fractal_type = grid::fractal_type;
+    frame.color5 = scene::color5;
+    frame.render_mode = grid::render_mode;
+    frame.fractal_min = scene::fractal_min;
+    frame.window_width = window::size[0];
+    frame.fractal_extent = scene::fractal_extent;
+    frame.window_height = window::size[1];
+    if (!scene::frame_uniforms_uploaded || std::memcmp(&frame, &scene::frame_uniforms, sizeof(frame)) != 0)
     {
-        glUniform3fv(cam_pos_loc, 1, glm::value_ptr(scene::camera.position()));
+        glBindBuffer(GL_UNIFORM_BUFFER, scene::frame_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+        scene::frame_uniforms = frame;
+        scene::frame_uniforms_uploaded = true;
     }
 
-    int color1_loc = glGetUniformLocation(scene::shader, "color1");
-    if (color1_loc != -1)
-    {
-        glUniform3fv(color1_loc, 1, glm::value_ptr(scene::color1));
-    }
-    int color2_loc = glGetUniformLocation(scene::shader, "color2");
-    if (color2_loc != -1)
+    // Density volume on texture unit 0, min/max pyramid on unit 1, the bindings the samplers are
+    // declared with. Until the first level of the bake arrives nothing is bound and the volume
+    // reads as empty.
+    if (scene::textureID != -1)
     {
-        glUniform3fv(color2_loc, 1, glm::value_ptr(scene::color2));
-    }
-    int color3_loc = glGetUniformLocation(scene::shader, "color3");
-    if (color3_loc != -1)
-    {
-        glUniform3fv(color3_loc, 1, glm::value_ptr(scene::color3));
-    }
-    int color4_loc = glGetUniformLocation(scene::shader, "color4");
-    if (color4_loc != -1)
-    {
-        glUniform3fv(color4_loc, 1, glm::value_ptr(scene::color4));
-    }
-    int color5_loc = glGetUniformLocation(scene::shader, "color5");
-    if (color5_loc != -1)
-    {
-        glUniform3fv(color5_loc, 1, glm::value_ptr(scene::color5));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, scene::textureID);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, scene::rangeTextureID);
+        glActiveTexture(GL_TEXTURE0);
     }
 
-
     glBindVertexArray(grid::points_vao);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, grid::points.size() / 3);
 
@@ -376,22 +706,105 @@ void display(GLFWwindow* window)
 
 void idle()
 {
+    update_sequence();
+    update_voxels();
+
     float time_sec = static_cast<float>(glfwGetTime());
 
     // Pass time_sec value to the shaders
-    int time_loc = glGetUniformLocation(scene::shader, "time");
+    int time_loc = GetShaderReflection(scene::shader).location("time");
     if (time_loc != -1)
     {
         glUniform1f(time_loc, time_sec);
     }
 }
 
+// Compile-time specializations for the current fractal settings
+std::string shader_defines()
+{
+    std::ostringstream defines;
+    int order = IntegerOrder(grid::order);
+    if (order != 0)
+    {
+        // Trig-free Mandelbulb for integer orders
+        defines << "#define MANDELBULB_ORDER " << order << "\n";
+    }
+    return defines.str();
+}
+
+// Compares the shader's FrameUniforms block with the C++ struct, a mismatch means FrameUniforms.h
+// and fractals_fs.glsl went out of sync. Prints every difference and returns false if there is one.
+bool check_frame_uniforms(GLuint program)
+{
+    const ShaderReflection::Block* block = GetShaderReflection(program).block("FrameUniforms");
+    if (block == nullptr)
+    {
+        return true;
+    }
+
+    struct Member
+    {
+        const char* name;
+        size_t offset;
+    };
+    const Member members[] = {
+        { "inv_P", offsetof(FrameUniforms, inv_P) },
+        { "inv_V", offsetof(FrameUniforms, inv_V) },
+        { "cam_pos", offsetof(FrameUniforms, cam_pos) },
+        { "order", offsetof(FrameUniforms, order) },
+        { "bound_center", offsetof(FrameUniforms, bound_center) },
+        { "bound_radius", offsetof(FrameUniforms, bound_radius) },
+        { "color1", offsetof(FrameUniforms, color1) },
+        { "range_levels", offsetof(FrameUniforms, range_levels) },
+        { "color2", offsetof(FrameUniforms, color2) },
+        { "range_cell_size", offsetof(FrameUniforms, range_cell_size) },
+        { "color3", offsetof(FrameUniforms, color3) },
+        { "max_iterations", offsetof(FrameUniforms, max_iterations) },
+        { "color4", offsetof(FrameUniforms, color4) },
+        { "fractal_type", offsetof(FrameUniforms, fractal_type) },
+        { "color5", offsetof(FrameUniforms, color5) },
+        { "render_mode", offsetof(FrameUniforms, render_mode) },
+        { "fractal_min", offsetof(FrameUniforms, fractal_min) },
+        { "window_width", offsetof(FrameUniforms, window_width) },
+        { "fractal_extent", offsetof(FrameUniforms, fractal_extent) },
+        { "window_height", offsetof(FrameUniforms, window_height) },
+    };
+
+    bool matches = true;
+    if (block->binding != GLint(FRAME_UNIFORMS_BINDING) || size_t(block->size) > sizeof(FrameUniforms))
+    {
+        matches = false;
+        std::cerr << "FrameUniforms: binding " << block->binding << ", " << block->size << " bytes, expected binding "
+                  << FRAME_UNIFORMS_BINDING << ", at most " << sizeof(FrameUniforms) << " bytes" << std::endl;
+    }
+    for (const Member& member : members)
+    {
+        auto offset = block->offsets.find(member.name);
+        // Members the compiler dropped have no offset, and don't matter
+        if (offset != block->offsets.end() && size_t(offset->second) != member.offset)
+        {
+            matches = false;
+            std::cerr << "FrameUniforms: " << member.name << " is at byte " << offset->second << " in the shader, "
+                      << member.offset << " in FrameUniforms.h" << std::endl;
+        }
+    }
+    return matches;
+}
+
 void reload_shader()
 {
     std::string vs = scene::shader_dir + scene::vertex_shader;
     std::string fs = scene::shader_dir + scene::fragment_shader;
  
+    SetShaderDefines(shader_defines().c_str());
     GLuint new_shader = InitShader(vs.c_str(), fs.c_str());
+    if (new_shader != -1 && !check_frame_uniforms(new_shader))
+    {
+        // Drawing with it would read the per-frame uniforms from the wrong bytes
+        std::cerr << "Shader program rejected, its FrameUniforms block doesn't match FrameUniforms.h" << std::endl;
+        DeleteShaderProgram(new_shader);
+        new_shader = -1;
+    }
  
     if (new_shader == -1) // loading failed
     {
@@ -403,9 +816,11 @@ void reload_shader()
  
        if (scene::shader != -1)
        {
-           glDeleteProgram(scene::shader);
+           DeleteShaderProgram(scene::shader);
        }
        scene::shader = new_shader;
+       // Another program may have been given the old name, so the next frame uploads again
+       scene::frame_uniforms_uploaded = false;
     }
 }
 
@@ -533,9 +948,17 @@ void init()
     // info_file << oss.str();
     // info_file.close();
 
+    // Filled by display() once a frame
+    glGenBuffers(1, &scene::frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, scene::frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, scene::frame_ubo);
+
     reload_shader();
 
     init_grid();
+    scene::volume_upload = std::make_unique<VolumeUploader>();
+    scene::gpu_bake = std::make_unique<GpuBaker>(scene::shader_dir);
     init_voxels();
 
     // Set the color the screen will be cleared to when glClear is called
@@ -603,6 +1026,12 @@ int main(void)
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
+
+    // Stop the bake and free the upload ring while the GL context still exists
+    scene::volume_bake.reset();
+    scene::volume_sequence.reset();
+    scene::volume_upload.reset();
+    scene::gpu_bake.reset();
  
     glfwTerminate();
     return 0;
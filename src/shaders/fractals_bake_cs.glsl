@@ -0,0 +1,209 @@
+#version 430
+
+// Bakes the density or distance volume straight into the volume texture, one 8^3 brick per work
+// group. The kernels are the ones in Fractal.cpp, evaluated at every voxel center: the CPU bake's
+// symmetry, interval and subdivision shortcuts don't apply here.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+layout(r32f, binding = 0) uniform writeonly image3D volume;
+
+uniform int first_layer;            // brick layer of the first work group in z
+uniform int resolution;
+uniform vec3 bounds_min;
+uniform vec3 voxel_size;
+uniform int fractal_type;
+uniform float order;
+uniform int max_iterations;
+uniform int integer_order;          // order if it is an integer from 2 to 16, 0 otherwise
+uniform float interior_radius2;     // MandelbulbInteriorRadius(order) squared
+uniform int field;                  // 0 density, 1 distance
+uniform float distance_scale;       // fractal space distances to volume units
+uniform float distance_band;
+
+const float MANDELBOX_BAILOUT = 1024.0;
+
+// (re + i im)^n by squaring, taking the bits of n from the top like ComplexPower<N> in Triplex.h
+vec2 complexPower(vec2 c, int n) {
+	vec2 result = c;
+	for (int bit = findMSB(n) - 1; bit >= 0; --bit) {
+		result = vec2(result.x * result.x - result.y * result.y, 2.0 * result.x * result.y);
+		if (((n >> bit) & 1) != 0)
+			result = vec2(result.x * c.x - result.y * c.y, result.x * c.y + result.y * c.x);
+	}
+	return result;
+}
+
+float integerPower(float x, int n) {
+	if (n == 0)
+		return 1.0;
+	float result = x;
+	for (int bit = findMSB(n) - 1; bit >= 0; --bit) {
+		result *= result;
+		if (((n >> bit) & 1) != 0)
+			result *= x;
+	}
+	return result;
+}
+
+// Closed-form triplex power, TriplexPower<N> in Triplex.h
+vec3 triplexPower(vec3 z, int n) {
+	float rho = sqrt(z.x * z.x + z.y * z.y);
+	vec2 azimuth = rho > 0.0 ? z.xy * (1.0 / rho) : vec2(1.0, 0.0);
+	vec2 cos_sin_n_phi = complexPower(azimuth, n);
+	vec2 polar = complexPower(vec2(z.z, rho), n);   // both scaled by r^n
+	return vec3(polar.y * cos_sin_n_phi.x, polar.y * cos_sin_n_phi.y, polar.x);
+}
+
+// Polar form for fractional orders
+vec3 polarPower(vec3 z, float r) {
+	float theta = acos(z.z / r) * order;
+	float phi = atan(z.y, z.x) * order;
+	return vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta)) * pow(r, order);
+}
+
+// Iteration the orbit escaped at, max_iterations if it never did
+int mandelbulbIteration(vec3 point) {
+	if (dot(point, point) <= interior_radius2)
+		return max_iterations;
+	vec3 z = point;
+	int i;
+	for (i = 0; i < max_iterations; i++) {
+		float r2 = dot(z, z);
+		if (r2 > 4.0)
+			break;
+		z = (integer_order != 0 ? triplexPower(z, integer_order) : polarPower(z, sqrt(r2))) + point;
+	}
+	return i;
+}
+
+float mandelbulbDistance(vec3 point) {
+	if (dot(point, point) <= interior_radius2)
+		return 0.0;
+	vec3 z = point;
+	float dr = 1.0;
+	for (int i = 0; i < max_iterations; i++) {
+		float r = length(z);
+		if (r > 2.0)
+			return 0.5 * log(r) * r / dr;
+		if (integer_order != 0) {
+			dr = float(integer_order) * integerPower(r, integer_order - 1) * dr + 1.0;
+			z = triplexPower(z, integer_order) + point;
+		}
+		else {
+			dr = pow(r, order - 1.0) * order * dr + 1.0;
+			z = polarPower(z, r) + point;
+		}
+	}
+	return 0.0;
+}
+
+float mandelboxDensity(vec3 point) {
+	vec3 zeta = point;
+	float rad = length(zeta);
+	int i;
+	for (i = 0; i < max_iterations; i++) {
+		if (rad > MANDELBOX_BAILOUT)
+			break;
+		zeta = clamp(zeta, -1.0, 1.0) * 2.0 - zeta;
+		if (rad < 0.5)
+			zeta *= 4.0;
+		else if (rad < 1.0)
+			zeta /= rad * rad;
+		zeta = zeta * order + point;
+		rad = length(zeta);
+	}
+	return float(i) / float(max_iterations);
+}
+
+float mandelboxDistance(vec3 point) {
+	vec3 zeta = point;
+	float rad = length(zeta);
+	float dr = 1.0;
+	for (int i = 0; i < max_iterations; i++) {
+		if (rad > MANDELBOX_BAILOUT)
+			return rad / abs(dr);
+		zeta = clamp(zeta, -1.0, 1.0) * 2.0 - zeta;
+		float fold = 1.0;
+		if (rad < 0.5)
+			fold = 4.0;
+		else if (rad < 1.0)
+			fold = 1.0 / (rad * rad);
+		zeta = zeta * fold * order + point;
+		dr = dr * fold * abs(order) + 1.0;
+		rad = length(zeta);
+	}
+	return 0.0;
+}
+
+bool inMiddleThird(float v) {
+	return v > 1.0 / 3.0 && v < 2.0 / 3.0;
+}
+
+float mengerSpongeDensity(vec3 point) {
+	vec3 pos = point;
+	float scale = 1.0;
+	for (int i = 0; i < max_iterations; ++i) {
+		pos = mod(pos, scale) - 0.5 * scale;
+		if (scale > 0.01)
+			pos = abs(pos) / scale;
+		bool x = inMiddleThird(pos.x);
+		bool y = inMiddleThird(pos.y);
+		bool z = inMiddleThird(pos.z);
+		if ((x && (y || z)) || (y && z))
+			return 0.0;
+		scale /= 3.0;
+	}
+	return 1.0;
+}
+
+float mengerSpongeDistance(vec3 point) {
+	vec3 pos = point;
+	float scale = 1.0;
+	float stretch = 1.0;
+	for (int i = 0; i < max_iterations; ++i) {
+		pos = mod(pos, scale) - 0.5 * scale;
+		if (scale <= 0.01)
+			break;
+		pos = abs(pos) / scale;
+		stretch /= scale;
+
+		// Out of a hole by bringing all but one coordinate back below 1/3
+		vec3 excess = pos - 1.0 / 3.0;
+		float high = max(max(excess.x, excess.y), excess.z);
+		float low = min(min(excess.x, excess.y), excess.z);
+		float mid = excess.x + excess.y + excess.z - high - low;
+		if (mid > 0.0) {
+			float d = low > 0.0 ? sqrt(mid * mid + low * low) : mid;
+			return d / stretch;
+		}
+		scale /= 3.0;
+	}
+	return 0.0;
+}
+
+float fractalDensity(vec3 point) {
+	if (fractal_type == 1)
+		return mandelboxDensity(point);
+	if (fractal_type == 2)
+		return mengerSpongeDensity(point);
+	return float(mandelbulbIteration(point)) / float(max_iterations);
+}
+
+float fractalDistance(vec3 point) {
+	if (fractal_type == 1)
+		return mandelboxDistance(point);
+	if (fractal_type == 2)
+		return mengerSpongeDistance(point);
+	return mandelbulbDistance(point);
+}
+
+void main(void)
+{
+	ivec3 voxel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, first_layer * 8);
+	if (any(greaterThanEqual(voxel, ivec3(resolution))))
+		return;
+
+	vec3 point = bounds_min + (vec3(voxel) + 0.5) * voxel_size;
+	float value = field == 1 ? min(fractalDistance(point) * distance_scale, distance_band) : fractalDensity(point);
+	imageStore(volume, voxel, vec4(value));
+}
@@ -1,22 +1,33 @@
 #version 430
 
-uniform mat4 P;
-uniform mat4 V;
-uniform float order;
-uniform float step_size;
-uniform int max_iterations;
-uniform int fractal_type;
-uniform vec3 cam_pos;
-//uniform sampler3D voxelTexture;
-uniform sampler3D densityTexture;
-uniform int window_width;
-uniform int window_height;
+// Everything that changes at most once a frame, filled from FrameUniforms in FrameUniforms.h
+layout(std140, binding = 0) uniform FrameUniforms {
+	mat4 inv_P;
+	mat4 inv_V;
+	vec3 cam_pos;
+	float order;
+	vec3 bound_center;          // sphere around the fractal in texture coordinates,
+	float bound_radius;         // outside it the volume is empty; radius 0 when there is none
+	vec3 color1;
+	int range_levels;           // 0 when there is no pyramid, the marcher then steps through everything
+	vec3 color2;
+	float range_cell_size;      // side of a level 0 cell in texture coordinates
+	vec3 color3;
+	int max_iterations;
+	vec3 color4;
+	int fractal_type;
+	vec3 color5;
+	int render_mode;            // 0 accumulates a density volume, 1 sphere traces a distance volume,
+	                            // 2 sphere traces the fractal's distance estimate without any volume
+	vec3 fractal_min;           // fractal space point at texture coordinate 0,
+	int window_width;
+	vec3 fractal_extent;        // and the size of the volume there
+	int window_height;
+};
 
-uniform vec3 color1;
-uniform vec3 color2;
-uniform vec3 color3;
-uniform vec3 color4;
-uniform vec3 color5;
+//uniform sampler3D voxelTexture;
+layout(binding = 0) uniform sampler3D densityTexture;
+layout(binding = 1) uniform sampler3D rangeTexture;     // min/max density per brick, mip level l covers 2^l bricks per side
 
 
 in vec4 v_pos;
@@ -77,7 +88,7 @@ float Mandelbulb(vec3 position, int maxIterations)
 	float y = 0.f;
 	float z = 0.f;
 
-	for (unsigned int iter = 0; iter <= maxIterations; ++iter) {
+	for (int iter = 0; iter <= maxIterations; ++iter) {
 		float xx = x * x;
 		float yy = y * y;
 		float zz = z * z;
@@ -147,6 +158,24 @@ float MengerSponge(vec3 pos, float scale, int iterations) {
 	return length(init_pos) / 3.0; // Not inside any hole, so keep
 }
 
+#ifdef MANDELBULB_ORDER
+// (re + i im)^MANDELBULB_ORDER, the trip count is a constant so the loop unrolls
+vec2 complexPower(vec2 c) {
+	vec2 result = c;
+	for (int k = 1; k < MANDELBULB_ORDER; ++k)
+		result = vec2(result.x * c.x - result.y * c.y, result.x * c.y + result.y * c.x);
+	return result;
+}
+
+// z^MANDELBULB_ORDER for a triplex number, the polar form below expanded with de Moivre so it needs no trig
+vec3 triplexPower(vec3 z) {
+	float rho = length(z.xy);
+	vec2 azimuth = complexPower(rho > 0.0 ? z.xy / rho : vec2(1.0, 0.0)); // (cos, sin) of n * phi
+	vec2 polar = complexPower(vec2(z.z, rho));                            // r^n * (cos, sin) of n * theta
+	return vec3(polar.y * azimuth.x, polar.y * azimuth.y, polar.x);
+}
+#endif
+
 // Return the normalized escape-time density of a point for the Mandelbulb
 float MandelbulbDensity(vec3 position, float bailout, int maxIterations, float power) {
 	vec3 z = position;
@@ -160,6 +189,14 @@ float MandelbulbDensity(vec3 position, float bailout, int maxIterations, float p
 			return density;
 		}
 
+#ifdef MANDELBULB_ORDER
+		// Integer order set by the application, power is ignored
+		float rPower = 1.0;
+		for (int k = 1; k < MANDELBULB_ORDER; ++k)
+			rPower *= r;
+		dr = rPower * float(MANDELBULB_ORDER) * dr + 1.0;
+		z = triplexPower(z);
+#else
 		// Convert to polar coordinates
 		float theta = acos(z.z / r);
 		float phi = atan(z.y, z.x);
@@ -172,12 +209,104 @@ float MandelbulbDensity(vec3 position, float bailout, int maxIterations, float p
 
 		// Convert back to Cartesian coordinates
 		z = zr * vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta));
+#endif
 		z += position;
 	}
 	// The point didn't escape, consider it as fully inside the fractal (max density)
 	return 1.0;
 }
 
+// Distance estimates, lower bounds on the distance to the fractal that are 0 inside it, the same
+// as FractalDistance() in Fractal.cpp and the bake compute shader
+
+// 0.5 * log(r) * r / dr from the derivative MandelbulbDensity carries along
+float MandelbulbDistance(vec3 position, int maxIterations, float power) {
+	vec3 z = position;
+	float dr = 1.0;
+	for (int i = 0; i < maxIterations; i++) {
+		float r = length(z);
+		if (r > 2.0)
+			return 0.5 * log(r) * r / dr;
+
+#ifdef MANDELBULB_ORDER
+		float rPower = 1.0;
+		for (int k = 1; k < MANDELBULB_ORDER; ++k)
+			rPower *= r;
+		dr = rPower * float(MANDELBULB_ORDER) * dr + 1.0;
+		z = triplexPower(z);
+#else
+		float theta = acos(z.z / r) * power;
+		float phi = atan(z.y, z.x) * power;
+		dr = pow(r, power - 1.0) * power * dr + 1.0;
+		z = pow(r, power) * vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta));
+#endif
+		z += position;
+	}
+	return 0.0;
+}
+
+// r / |dr| of the escaped orbit, dr scaled by every fold and by the order like Mandelbox's delta_rad
+float MandelboxDistance(vec3 pos, int maxIterations) {
+	vec3 zeta = pos;
+	float rad = length(zeta);
+	float dr = 1.0;
+	for (int i = 0; i < maxIterations; i++) {
+		if (rad > 1024.0)
+			return rad / abs(dr);
+		zeta = clamp(zeta, -1.0, 1.0) * 2.0 - zeta;
+		float fold = 1.0;
+		if (rad < 0.5)
+			fold = 4.0;
+		else if (rad < 1.0)
+			fold = 1.0 / (rad * rad);
+		zeta = zeta * fold * order + pos;
+		dr = dr * fold * abs(order) + 1.0;
+		rad = length(zeta);
+	}
+	return 0.0;
+}
+
+// Distance out of the hole the point is in, over the stretch of every level folded so far
+float MengerSpongeDistance(vec3 pos, int iterations) {
+	float scale = 1.0;
+	float stretch = 1.0;
+	for (int i = 0; i < iterations; ++i) {
+		pos = mod(pos, scale) - 0.5 * scale;
+		if (scale <= 0.01)
+			break;
+		pos = abs(pos) / scale;
+		stretch /= scale;
+
+		vec3 excess = pos - 1.0 / 3.0;
+		float high = max(max(excess.x, excess.y), excess.z);
+		float low = min(min(excess.x, excess.y), excess.z);
+		float mid = excess.x + excess.y + excess.z - high - low;
+		if (mid > 0.0)
+			return (low > 0.0 ? sqrt(mid * mid + low * low) : mid) / stretch;
+		scale /= 3.0;
+	}
+	return 0.0;
+}
+
+// Distance estimate of the selected fractal at a point in texture coordinates, in texture coordinates.
+// Dividing by the largest side keeps it a lower bound if the volume isn't a cube.
+float fractalDistance(vec3 pos) {
+	vec3 point = fractal_min + pos * fractal_extent;
+	float distance;
+	if (fractal_type == 1)
+		distance = MandelboxDistance(point, max_iterations);
+	else if (fractal_type == 2)
+		distance = MengerSpongeDistance(point, max_iterations);
+	else
+		distance = MandelbulbDistance(point, max_iterations, order);
+	return distance / max(max(fractal_extent.x, fractal_extent.y), fractal_extent.z);
+}
+
+// What the shading below samples: the volume texture, or the distance estimate when there is none
+float fieldValue(vec3 pos) {
+	return render_mode == 2 ? fractalDistance(pos) : texture(densityTexture, pos).r;
+}
+
 
 vec4 TransferFunction(float density) {
 	// Convert density to a grayscale color
@@ -229,7 +358,7 @@ float ambientOcclusion(vec3 pos, vec3 normal, float scale, float bias, int sampl
 	for (int i = 0; i < samples; ++i) {
 		float dist = float(i) / float(samples) * scale;
 		vec3 samplePos = pos + normal * (dist + bias);
-		float sampleDensity = texture(densityTexture, samplePos).r;
+		float sampleDensity = fieldValue(samplePos);
 		ao += (dist - bias - sampleDensity) * weight;
 		weight *= 0.5;
 	}
@@ -238,25 +367,245 @@ float ambientOcclusion(vec3 pos, vec3 normal, float scale, float bias, int sampl
 	return clamp(1.0 - ao / float(samples), 0.0, 1.0);
 }
 
+// Occlusion for the distance modes: open space k * step away from the surface is at least
+// k * step from it, so whatever the distance falls short of that along outward is occluded
+float distanceOcclusion(vec3 pos, vec3 outward, float step, int samples) {
+	float occluded = 0.0;
+	float open = 0.0;
+	float weight = 1.0;
+	for (int k = 1; k <= samples; ++k) {
+		float reach = float(k) * step;
+		occluded += max(reach - fieldValue(pos + outward * reach), 0.0) * weight;
+		open += reach * weight;
+		weight *= 0.5;
+	}
+	return clamp(1.0 - occluded / open, 0.0, 1.0);
+}
+
 vec3 calculateNormal(vec3 pos) {
 	float eps = 0.001;  // A small value to offset the position for gradient calculation
 	vec3 normal;
 
 	// Sample the density field at points around the current position
-	float densityCenter = texture(densityTexture, pos).r;
-	float densityX = texture(densityTexture, vec3(pos.x + eps, pos.y, pos.z)).r;
-	float densityY = texture(densityTexture, vec3(pos.x, pos.y + eps, pos.z)).r;
-	float densityZ = texture(densityTexture, vec3(pos.x, pos.y, pos.z + eps)).r;
+	float densityCenter = fieldValue(pos);
+	float densityX = fieldValue(vec3(pos.x + eps, pos.y, pos.z));
+	float densityY = fieldValue(vec3(pos.x, pos.y + eps, pos.z));
+	float densityZ = fieldValue(vec3(pos.x, pos.y, pos.z + eps));
 
 	// Calculate gradient (central difference)
 	normal.x = densityX - densityCenter;
 	normal.y = densityY - densityCenter;
 	normal.z = densityZ - densityCenter;
 
+	// Densities grow into the fractal while distances shrink toward it, so the distance
+	// gradient is flipped to point inward like the density one
+	if (render_mode != 0)
+		normal = -normal;
+
 	// Normalize to get the unit normal
 	return normalize(normal);
 }
 
+// Reach of the linear filter past the last texel that holds density
+float filterBorder() {
+	return 1.0 / float(textureSize(densityTexture, 0).x);
+}
+
+// Keeps every component of a direction away from zero so it can be divided by
+vec3 safeDirection(vec3 dir) {
+	return (step(0.0, dir) * 2.0 - 1.0) * max(abs(dir), vec3(1e-8));
+}
+
+// Ray interval [t_enter, t_exit] inside the texture coordinate cube grown by border on every side, empty if t_enter >= t_exit
+void clipToVolume(vec3 origin, vec3 dir, float border, float max_length, out float t_enter, out float t_exit) {
+	vec3 t_lo = (vec3(-border) - origin) / dir;
+	vec3 t_hi = (vec3(1.0 + border) - origin) / dir;
+	vec3 t_near = min(t_lo, t_hi);
+	vec3 t_far = max(t_lo, t_hi);
+	t_enter = max(max(max(t_near.x, t_near.y), t_near.z), 0.0);
+	t_exit = min(min(min(t_far.x, t_far.y), t_far.z), max_length);
+}
+
+// Narrows [t_enter, t_exit] to the part of the ray inside the sphere, empty if it misses
+void clipToSphere(vec3 origin, vec3 dir, vec3 center, float radius, inout float t_enter, inout float t_exit) {
+	vec3 offset = origin - center;
+	float b = dot(offset, dir);
+	float c = dot(offset, offset) - radius * radius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0) {
+		t_exit = t_enter;
+		return;
+	}
+	float root = sqrt(discriminant);
+	t_enter = max(t_enter, -b - root);
+	t_exit = min(t_exit, -b + root);
+}
+
+// clipToVolume, then to the fractal's bounding sphere. A lookup reads the texels up to border away
+// on every axis, so the sphere grows by the diagonal of that.
+void clipRay(vec3 origin, vec3 dir, float border, float max_length, out float t_enter, out float t_exit) {
+	clipToVolume(origin, dir, border, max_length, t_enter, t_exit);
+	if (bound_radius > 0.0)
+		clipToSphere(origin, dir, bound_center, bound_radius + border * sqrt(3.0), t_enter, t_exit);
+}
+
+// Distance along the ray to the far side of the axis-aligned cell [cell_min, cell_min + cell_size)
+float cellExit(vec3 pos, vec3 dir, vec3 cell_min, float cell_size) {
+	vec3 far_plane = cell_min + step(0.0, dir) * cell_size;
+	vec3 t = (far_plane - pos) / dir;
+	return max(min(min(t.x, t.y), t.z), 0.0);
+}
+
+// Height of a pixel at distance 1 from the camera, inv_P[1][1] is tan(fov / 2)
+float pixelSize() {
+	return 2.0 * inv_P[1][1] / float(window_height);
+}
+
+const float MIN_STEP = 0.0005;      // the step the marcher used to take everywhere, density sums are in units of it
+const int BISECTION_STEPS = 6;
+
+// Adaptive density march from t to t_end. Every step adds the trapezoid of the densities at its
+// ends scaled to MIN_STEP, so the sum is the one a march at MIN_STEP would reach. Steps double
+// while the density stays flat and low, up to a texel or the pixel footprint, and halve where it
+// changes. The step that takes the sum to 1 is bisected so the hit stays within a fraction of
+// MIN_STEP. density is the density at t, h the step length carried between calls.
+// Returns true on a hit, with t on it.
+bool marchAdaptive(vec3 origin, vec3 dir, float t_end, inout float t, inout float h, inout float density, inout float accumulated_density) {
+	float texel = 1.0 / float(textureSize(densityTexture, 0).x);
+	float pixel_size = pixelSize();
+	while (t < t_end) {
+		float footprint = 0.5 * pixel_size * t;
+		float min_step = max(MIN_STEP, footprint);
+		h = clamp(h, min_step, max(texel, min_step));
+		float t_next = min(t + h, t_end);
+		float next_density = texture(densityTexture, origin + dir * t_next).r;
+		float added = 0.5 * (density + next_density) * (t_next - t) / MIN_STEP;
+
+		if (accumulated_density + added >= 1.0) {
+			// Narrow the step down to where the sum reaches 1
+			for (int i = 0; i < BISECTION_STEPS; ++i) {
+				float t_mid = 0.5 * (t + t_next);
+				float mid_density = texture(densityTexture, origin + dir * t_mid).r;
+				float part = 0.5 * (density + mid_density) * (t_mid - t) / MIN_STEP;
+				if (accumulated_density + part >= 1.0) {
+					t_next = t_mid;
+					next_density = mid_density;
+					added = part;
+				}
+				else {
+					accumulated_density += part;
+					added = 0.5 * (mid_density + next_density) * (t_next - t_mid) / MIN_STEP;
+					t = t_mid;
+					density = mid_density;
+				}
+			}
+			// The halves' trapezoids don't quite add up to the whole one, the hit counts as 1 either way
+			accumulated_density = max(accumulated_density + added, 1.0);
+			t = t_next;
+			return true;
+		}
+
+		float change = abs(next_density - density);
+		accumulated_density += added;
+		t = t_next;
+		density = next_density;
+		if (change > 0.05 || added > 0.25)
+			h *= 0.5;
+		else if (change < 0.01 && added < 0.05)
+			h *= 2.0;
+	}
+	return false;
+}
+
+// Adaptive march of the density texture from origin (in texture coordinates) that leaps over
+// empty cells of the min/max pyramid. A cell is only skipped when its max density is 0, so the
+// sum is the plain march's up to where the samples fall. Empty cells send the walk up a level,
+// occupied ones down, and level 0 cells that hold density get marchAdaptive.
+// Returns the distance to the hit, or max_length; accumulated_density is the march's sum.
+float marchRange(vec3 origin, vec3 dir, float max_length, inout float accumulated_density) {
+	dir = safeDirection(dir);
+
+	// Outside the volume plus the half texel the linear filter bleeds into the border, nothing is ever sampled
+	float t_enter, t_exit;
+	clipRay(origin, dir, filterBorder(), max_length, t_enter, t_exit);
+
+	float t = t_enter;
+	float h = 0.0;
+	float density = texture(densityTexture, origin + dir * t).r;
+	int level = range_levels - 1;
+	while (t < t_exit) {
+		vec3 pos = origin + dir * t;
+		float cell_size = range_cell_size * exp2(float(level));
+		ivec3 cell = clamp(ivec3(floor(pos / cell_size)), ivec3(0), textureSize(rangeTexture, level) - 1);
+		// At least a step, so positions rounded onto the face of the cell behind, or clamped into
+		// the last cell from the filter border, move on
+		float t_cell = t + max(cellExit(pos, dir, vec3(cell) * cell_size, cell_size), MIN_STEP);
+
+		if (texelFetch(rangeTexture, cell, level).g <= 0.0) {
+			// Empty, every filtered lookup inside it reads 0, continue past it one level up
+			t = t_cell;
+			density = 0.0;
+			level = min(level + 1, range_levels - 1);
+			continue;
+		}
+		if (level > 0) {
+			level--;
+			continue;
+		}
+
+		// Occupied brick, march through it
+		if (marchAdaptive(origin, dir, min(t_cell, t_exit), t, h, density, accumulated_density))
+			return t;
+	}
+
+	// Nothing hit, end where the plain march would have
+	return max_length;
+}
+
+
+const int MAX_TRACE_STEPS = 256;
+
+// Sphere traces the distance volume from origin (in texture coordinates). Every stored distance is
+// a lower bound on the distance to the surface, so stepping by it never jumps over the fractal.
+// Returns the distance to the hit, or -1 if the ray leaves the volume without one.
+float sphereTrace(vec3 origin, vec3 dir, float max_length) {
+	dir = safeDirection(dir);
+
+	// The texture border holds the band distance, so only the volume itself needs tracing
+	float t_enter, t_exit;
+	clipRay(origin, dir, 0.0, max_length, t_enter, t_exit);
+
+	float hit_distance = 0.5 / float(textureSize(densityTexture, 0).x);
+	float t = t_enter;
+	for (int i = 0; i < MAX_TRACE_STEPS && t < t_exit; ++i) {
+		float distance = texture(densityTexture, origin + dir * t).r;
+		if (distance < hit_distance)
+			return t;
+		t += distance;
+	}
+	return -1.0;
+}
+
+// Sphere traces the distance estimate itself from origin (in texture coordinates), so the detail
+// doesn't stop at a voxel: a ray hits once it is closer than half the footprint of its pixel.
+// Returns the distance to the hit, or -1 like sphereTrace.
+float sphereTraceDirect(vec3 origin, vec3 dir, float max_length) {
+	dir = safeDirection(dir);
+
+	float t_enter, t_exit;
+	clipRay(origin, dir, 0.0, max_length, t_enter, t_exit);
+
+	float pixel_size = pixelSize();
+	float t = t_enter;
+	for (int i = 0; i < MAX_TRACE_STEPS && t < t_exit; ++i) {
+		float distance = fractalDistance(origin + dir * t);
+		if (distance < max(0.5 * pixel_size * t, 1e-6))
+			return t;
+		t += distance;
+	}
+	return -1.0;
+}
+
 
 void main(void)
 {
@@ -265,31 +614,50 @@ void main(void)
 	fragcolor = vec4(1.0, 0.1, 1.0, 1.0);
 
 	vec2 ndc_pos = 2.0 * vec2(gl_FragCoord.x / window_width, gl_FragCoord.y / window_height) - 1.0;
-	vec4 cam_dir = inverse(P) * vec4(ndc_pos, 1.0, 1.0);
+	vec4 cam_dir = inv_P * vec4(ndc_pos, 1.0, 1.0);
 	cam_dir /= cam_dir.w;
 	cam_dir = vec4(cam_dir.xyz, 0.0);
 
-	vec4 ray_dir = normalize(inverse(V) * cam_dir);
+	vec4 ray_dir = normalize(inv_V * cam_dir);
 
 	vec4 accumulate_color = vec4(0.0);
 	float accumulate_alpha = 0.0;
 	float accumulated_density = 0.0;
-	float step_size = 0.0005;
 	float max_length = 10.0;
 	float density = 0.0;
 	vec4 color = vec4(0.0);
 	float t = 0.0;
 
-	for (t; t < max_length; t += step_size) {
-		float density = texture(densityTexture, ray_pos+0.5).r;
-		accumulated_density += density;
+	// Rays that miss the volume, or the sphere the fractal is in, would accumulate nothing
+	float t_enter, t_exit;
+	clipRay(cam_pos + 0.5, safeDirection(ray_dir.xyz), render_mode == 0 ? filterBorder() : 0.0, max_length, t_enter, t_exit);
+	if (t_enter >= t_exit) {
+		fragcolor = vec4(0.0);
+		return;
+	}
 
-		ray_pos += ray_dir.xyz * step_size;
-		if (accumulated_density >= 1.0) break;
+	if (render_mode != 0) {
+		// Shaded like a density march that reached 1 at the surface
+		t = render_mode == 2 ? sphereTraceDirect(cam_pos + 0.5, ray_dir.xyz, max_length) : sphereTrace(cam_pos + 0.5, ray_dir.xyz, max_length);
+		accumulated_density = t >= 0.0 ? 1.0 : 0.0;
+		ray_pos = cam_pos + ray_dir.xyz * (t >= 0.0 ? t : max_length);
+	}
+	else if (range_levels > 0) {
+		t = marchRange(cam_pos + 0.5, ray_dir.xyz, max_length, accumulated_density);
+		ray_pos = cam_pos + ray_dir.xyz * t;
+	}
+	else {
+		// Through the clipped interval, past it every sample reads 0
+		t = t_enter;
+		float h = 0.0;
+		density = texture(densityTexture, cam_pos + 0.5 + ray_dir.xyz * t).r;
+		bool hit = marchAdaptive(cam_pos + 0.5, ray_dir.xyz, t_exit, t, h, density, accumulated_density);
+		ray_pos = cam_pos + ray_dir.xyz * (hit ? t : max_length);
 	}
 
 	vec3 normal = calculateNormal(ray_pos+0.5); // Implement this function to calculate the normal
-	float ao = ambientOcclusion(ray_pos+0.5, normal, 1.0, 0.01, 5); // Adjust scale, bias, and samples as needed
+	float ao = render_mode == 0 ? ambientOcclusion(ray_pos+0.5, normal, 1.0, 0.01, 5) // Adjust scale, bias, and samples as needed
+		: distanceOcclusion(ray_pos+0.5, -normal, 0.01, 5);
 
 
 	color = getColorFromDensity(accumulated_density, ray_pos);
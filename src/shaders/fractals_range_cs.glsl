@@ -0,0 +1,48 @@
+#version 430
+
+// One level of the min/max range texture from a volume baked on the GPU, one cell per invocation.
+// Level 0 is the range of each brick plus a one voxel apron, like MinMaxPyramid on the CPU, and
+// every level above is the union of eight cells of the level below.
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout(r32f, binding = 0) uniform readonly image3D volume;
+layout(rg32f, binding = 1) uniform readonly image3D fine;       // level - 1
+layout(rg32f, binding = 2) uniform writeonly image3D coarse;    // level
+
+uniform int level;
+uniform int size;           // cells per side of level
+uniform int bricks;         // bricks per side of the volume
+uniform int resolution;
+
+void main(void)
+{
+	ivec3 cell = ivec3(gl_GlobalInvocationID);
+	if (any(greaterThanEqual(cell, ivec3(size))))
+		return;
+
+	vec2 range = vec2(1e30, -1e30);
+	if (level > 0) {
+		for (int child = 0; child < 8; ++child) {
+			vec2 c = imageLoad(fine, 2 * cell + ivec3(child & 1, (child >> 1) & 1, (child >> 2) & 1)).rg;
+			range = vec2(min(range.x, c.x), max(range.y, c.y));
+		}
+	}
+	else if (any(greaterThanEqual(cell, ivec3(bricks)))) {
+		// Padding up to a power of two reads the zero border
+		range = vec2(0.0);
+	}
+	else {
+		ivec3 lo = cell * 8 - 1;
+		for (int z = lo.z; z < lo.z + 10; ++z) {
+			for (int y = lo.y; y < lo.y + 10; ++y) {
+				for (int x = lo.x; x < lo.x + 10; ++x) {
+					ivec3 voxel = ivec3(x, y, z);
+					bool inside = all(greaterThanEqual(voxel, ivec3(0))) && all(lessThan(voxel, ivec3(resolution)));
+					float value = inside ? imageLoad(volume, voxel).r : 0.0;
+					range = vec2(min(range.x, value), max(range.y, value));
+				}
+			}
+		}
+	}
+	imageStore(coarse, cell, vec4(range, 0.0, 0.0));
+}